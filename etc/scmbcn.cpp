@@ -0,0 +1,151 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmbcn measures the loss of quality of block compressing the pages of an
+// SCM TIFF, as done by an scm_cache with compression enabled. Each page is
+// compressed and decompressed on the CPU and compared with the original, so no
+// GPU is needed. The page must have 8-bit samples of one to three channels.
+//
+//     scmbcn input.tif
+//
+// The root-mean-square and maximum error, and the peak signal-to-noise ratio,
+// of each channel over all pages are reported, with the compression ratio and
+// the throughput of the encoder in processor time.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+#include "../scm-bcn.hpp"
+#include "../scm-write.hpp"
+
+//------------------------------------------------------------------------------
+
+static double now()
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+// Read and decode the page at offset o of TIFF T into buffer p.
+
+static bool read(TIFF *T, uint64 o, uint8 *p)
+{
+    if (TIFFSetSubDirectory(T, o))
+    {
+        tsize_t N = TIFFNumberOfStrips(T);
+        tsize_t S = TIFFStripSize     (T);
+
+        for (tsize_t s = 0; s < N; ++s)
+            if (TIFFReadEncodedStrip(T, s, p + s * S, -1) == -1)
+                return false;
+
+        return true;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s input.tif\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    TIFF *T = TIFFOpen(argv[1], "r");
+
+    if (T == 0)
+        return EXIT_FAILURE;
+
+    std::vector<uint64> x;
+    std::vector<uint64> o;
+    std::vector<uint8>  a;
+    std::vector<uint8>  z;
+
+    if (!scm_read_catalog(T, x, o, a, z))
+    {
+        fprintf(stderr, "%s: missing page catalog\n", argv[1]);
+        TIFFClose(T);
+        return EXIT_FAILURE;
+    }
+
+    uint32 w = 0, h = 0;
+    uint16 c = 0, b = 0;
+
+    TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &w);
+    TIFFGetField(T, TIFFTAG_IMAGELENGTH,     &h);
+    TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &b);
+    TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &c);
+
+    if (scm_bcn_form(c, b) == 0)
+    {
+        fprintf(stderr, "%s: %d-bit %d-channel pages are not compressed\n",
+                        argv[1], int(b), int(c));
+        TIFFClose(T);
+        return EXIT_FAILURE;
+    }
+
+    const size_t m = size_t(w) * h * c;
+
+    std::vector<uint8>  p(m);
+    std::vector<uint8>  q(m);
+    std::vector<uint8>  e(scm_bcn_size(int(w), int(h), int(c)));
+    std::vector<double> E(c, 0.0);
+    std::vector<int>    M(c, 0);
+
+    size_t pages = 0;
+    double t     = 0;
+
+    // Compress, decompress, and compare each page.
+
+    for (size_t k = 0; k < x.size(); ++k)
+        if (o[k] && read(T, o[k], &p.front()))
+        {
+            double t0 = now();
+            scm_bcn_encode(int(w), int(h), int(c), &p.front(), &e.front());
+            t += now() - t0;
+
+            scm_bcn_decode(int(w), int(h), int(c), &e.front(), &q.front());
+
+            for (size_t j = 0; j < m; ++j)
+            {
+                const int d = int(p[j]) - int(q[j]);
+
+                E[j % c] += double(d) * d;
+                M[j % c]  = std::max(M[j % c], std::abs(d));
+            }
+            pages++;
+        }
+
+    TIFFClose(T);
+
+    // Report.
+
+    const double MB = double(pages) * m / 1048576.0;
+
+    printf("%lu pages, ratio %.2f, encode %.1f MB/s\n", (unsigned long) pages,
+           double(m) / double(e.size()), t > 0 ? MB / t : 0.0);
+
+    for (int d = 0; d < c; ++d)
+    {
+        const double r = pages ? sqrt(E[d] / (double(pages) * w * h)) : 0.0;
+
+        printf("channel %d: RMSE %.3f, max %3d, PSNR %.2f dB\n", d, r, M[d],
+               r > 0 ? 20.0 * log10(255.0 / r) : HUGE_VAL);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmbench times the SCM page index arithmetic over millions of page indices
+// drawn uniformly from an SCM of the given depth.
+//
+//     scmbench [count] [depth]
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+#include "../scm-index.hpp"
+
+//------------------------------------------------------------------------------
+
+static double now()
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static void report(const char *name, double t, long long n, long long sum)
+{
+    printf("%-8s %8.3f ns/op (%llx)\n", name, 1e9 * t / n, sum);
+}
+
+int main(int argc, char **argv)
+{
+    const long long n = (argc > 1) ? atoll(argv[1]) : 10000000;
+    const long long d = (argc > 2) ? atoll(argv[2]) :       20;
+    const long long m = scm_page_count(d);
+
+    std::vector<long long> I(n);
+
+    srand(1);
+
+    for (long long j = 0; j < n; ++j)
+        I[j] = (((long long) rand() << 31) ^ rand()) % m;
+
+    double    t;
+    long long s;
+
+    // Time each operation, accumulating results to defeat dead code removal.
+
+    t = now(); s = 0;
+    for (long long j = 0; j < n; ++j)
+    {
+        long long a, l, r, c;
+        scm_page_decode(I[j], a, l, r, c);
+        s += a + l + r + c;
+    }
+    report("decode", now() - t, n, s);
+
+    t = now(); s = 0;
+    for (long long j = 0; j < n; ++j)
+        s += scm_page_level(I[j]);
+    report("level", now() - t, n, s);
+
+    t = now(); s = 0;
+    for (long long j = 0; j < n; ++j)
+        s += scm_page_row(I[j]) + scm_page_col(I[j]);
+    report("row/col", now() - t, n, s);
+
+    t = now(); s = 0;
+    for (long long j = 0; j < n; ++j)
+        if (I[j] > 5) s += scm_page_parent(I[j]);
+    report("parent", now() - t, n, s);
+
+    t = now(); s = 0;
+    for (long long j = 0; j < n; ++j)
+        s += scm_page_child(I[j], j & 3);
+    report("child", now() - t, n, s);
+
+    t = now(); s = 0;
+    for (long long j = 0; j < n; ++j)
+        s += scm_page_north(I[j]) + scm_page_south(I[j])
+           + scm_page_west (I[j]) + scm_page_east (I[j]);
+    report("neighbor", now() - t, 4 * n, s);
+
+    return 0;
+}
@@ -0,0 +1,798 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmbuild resamples an equirectangular TIFF into an SCM TIFF of the given
+// page size and depth. The source must be stripped, not tiled, with samples
+// interleaved. Its first column lies at longitude -180 and its first row at
+// latitude +90, where a vector v gives longitude atan2(v[0], v[2]) and
+// latitude asin(v[1]).
+//
+//     scmbuild [-n size] [-d depth] [-t threads] [-m megabytes] in.tif out.tif
+//
+// Pages are built level by level from the deepest up. Each worker thread of
+// the deepest level reads the source through its own bounded cache of decoded
+// strips, resamples pages with supersampling matched to the source resolution,
+// and compresses them. Each coarser level is reduced from the finished level
+// below it, read back from the output through a bounded cache of decoded pages,
+// so that every pixel is the average of the four beneath it. The main thread
+// writes compressed pages in root and Hilbert curve order within each level,
+// followed by the catalog, whose extrema of each page bound all of its
+// descendants. Peak memory is bounded by the cache budget plus a few pages per
+// thread, whatever the size of the source. As the deepest level is written
+// first, scmorder may be used to place the coarser levels first.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <list>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "../scm-index.hpp"
+#include "../scm-write.hpp"
+
+//------------------------------------------------------------------------------
+
+// A source is an equirectangular TIFF read through a byte-budgeted LRU cache
+// of decoded strips. Each worker thread has its own. If a strip exceeds the
+// budget, as when the source is written as one huge strip, its rows are read
+// and cached singly instead, rather than each thread decoding it whole.
+
+class source
+{
+public:
+
+    source(const char *, size_t);
+   ~source();
+
+    bool ok() const { return T != 0 && !fail; }
+
+    void get(const double *, float *);
+
+    uint32 W;
+    uint32 H;
+    uint16 C;
+    uint16 B;
+
+private:
+
+    typedef std::pair<uint32, std::vector<uint8> > strip;
+    typedef std::list<strip>                       strip_l;
+
+    TIFF   *T;
+    uint32  R;
+    uint32  U;
+    size_t  line;
+    size_t  budget;
+    size_t  bytes;
+    bool    fail;
+
+    strip_l                             order;
+    std::map<uint32, strip_l::iterator> strips;
+
+    const uint8 *row(uint32);
+    float        value(const uint8 *, uint32, int) const;
+};
+
+source::source(const char *name, size_t budget) :
+    W(0), H(0), C(0), B(0), T(0), R(0), U(0), line(0), budget(budget),
+    bytes(0), fail(false)
+{
+    if ((T = TIFFOpen(name, "r")))
+    {
+        uint16 p = PLANARCONFIG_CONTIG;
+
+        TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &W);
+        TIFFGetField(T, TIFFTAG_IMAGELENGTH,     &H);
+        TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &B);
+        TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &C);
+        TIFFGetField(T, TIFFTAG_PLANARCONFIG,    &p);
+
+        if (!TIFFGetField(T, TIFFTAG_ROWSPERSTRIP, &R) || R > H)
+            R = H;
+
+        line = size_t(W) * C * B / 8;
+
+        // Cache whole strips if they fit the budget, or single rows if not.
+
+        U = (size_t(R) * line > budget) ? 1 : R;
+
+        if (TIFFIsTiled(T) || p != PLANARCONFIG_CONTIG
+                           || (B != 8 && B != 16 && B != 32))
+        {
+            fprintf(stderr, "%s: unsupported source layout\n", name);
+            TIFFClose(T);
+            T = 0;
+        }
+    }
+}
+
+source::~source()
+{
+    if (T) TIFFClose(T);
+}
+
+// Return a pointer to row y of the source, decoding its strip, or the row
+// alone, if necessary and ejecting the least-recently used to remain within
+// budget. Note any read failure.
+
+const uint8 *source::row(uint32 y)
+{
+    const uint32 s = y / U;
+
+    std::map<uint32, strip_l::iterator>::iterator i = strips.find(s);
+
+    if (i == strips.end())
+    {
+        while (bytes && bytes + U * line > budget)
+        {
+            bytes -= order.back().second.size();
+            strips.erase(order.back().first);
+            order.pop_back();
+        }
+
+        order.push_front(strip(s, std::vector<uint8>(U * line)));
+
+        uint8 *p = &order.front().second.front();
+
+        if ((U == R) ? (TIFFReadEncodedStrip(T, s, p, -1) < 0)
+                     : (TIFFReadScanline    (T, p, y,  0) < 0))
+        {
+            fprintf(stderr, "Failed to read row %u\n", y);
+            fail = true;
+        }
+
+        bytes += order.front().second.size();
+        i = strips.insert(std::make_pair(s, order.begin())).first;
+    }
+    else
+        order.splice(order.begin(), order, i->second);
+
+    return &i->second->second.front() + (y - s * U) * line;
+}
+
+// Return channel k of pixel x of the given row as a float.
+
+float source::value(const uint8 *p, uint32 x, int k) const
+{
+    switch (B)
+    {
+    case  8: return ((const uint8  *) p)[x * C + k];
+    case 16: return ((const uint16 *) p)[x * C + k];
+    default: return ((const float  *) p)[x * C + k];
+    }
+}
+
+// Sample the source along vector v using linear filtering, wrapping in
+// longitude and clamping in latitude.
+
+void source::get(const double *v, float *p)
+{
+    const double lon = atan2(v[0], v[2]);
+    const double lat = asin(std::max(-1.0, std::min(1.0, v[1])));
+
+    const double x = (lon + M_PI) / (2.0 * M_PI) * W - 0.5;
+    const double y = (M_PI_2 - lat) / M_PI       * H - 0.5;
+
+    const double fx = floor(x), tx = x - fx;
+    const double fy = floor(y), ty = y - fy;
+
+    const uint32 x0 = uint32((long long) (fx    ) % W + W) % W;
+    const uint32 x1 = uint32((long long) (fx + 1) % W + W) % W;
+    const uint32 y0 = uint32(std::max(0.0, std::min(double(H - 1), fy    )));
+    const uint32 y1 = uint32(std::max(0.0, std::min(double(H - 1), fy + 1)));
+
+    const uint8 *r0 = row(y0);
+    const uint8 *r1 = row(y1);
+
+    for (int k = 0; k < C; ++k)
+    {
+        const double a = value(r0, x0, k) * (1 - tx) + value(r0, x1, k) * tx;
+        const double b = value(r1, x0, k) * (1 - tx) + value(r1, x1, k) * tx;
+
+        p[k] = float(a * (1 - ty) + b * ty);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// A below is a finished level of the SCM TIFF being built, read back through a
+// byte-budgeted LRU cache of decoded pages. Each worker thread has its own,
+// taking ownership of a TIFF opened before the next level is appended, so that
+// the pages appended are never seen partially written.
+
+class below
+{
+public:
+
+    below(TIFF *, const std::vector<uint64>&, int, int, int, int, size_t);
+   ~below();
+
+    bool ok() const { return T != 0 && !fail; }
+
+    void get(const double *, float *);
+
+private:
+
+    typedef std::pair<long long, std::vector<uint8> > image;
+    typedef std::list<image>                          image_l;
+
+    TIFF                      *T;
+    const std::vector<uint64>& offset;
+    int                        l;
+    int                        n;
+    int                        c;
+    int                        b;
+    size_t                     budget;
+    size_t                     bytes;
+    bool                       fail;
+
+    image_l                                order;
+    std::map<long long, image_l::iterator> pages;
+
+    const uint8 *page(long long);
+    float        value(const uint8 *, size_t) const;
+};
+
+below::below(TIFF *T, const std::vector<uint64>& offset,
+             int l, int n, int c, int b, size_t budget) :
+    T(T), offset(offset), l(l), n(n), c(c), b(b),
+    budget(budget), bytes(0), fail(false)
+{
+}
+
+below::~below()
+{
+    if (T) TIFFClose(T);
+}
+
+// Return a pointer to the data of page i, decoding it if necessary and
+// ejecting the least-recently used pages to remain within budget. Note any
+// read failure.
+
+const uint8 *below::page(long long i)
+{
+    std::map<long long, image_l::iterator>::iterator j = pages.find(i);
+
+    if (j == pages.end())
+    {
+        if (TIFFSetSubDirectory(T, offset[size_t(i)]))
+        {
+            const tsize_t N = TIFFNumberOfStrips(T);
+            const tsize_t S = TIFFStripSize     (T);
+
+            while (bytes && bytes + size_t(N * S) > budget)
+            {
+                bytes -= order.back().second.size();
+                pages.erase(order.back().first);
+                order.pop_back();
+            }
+
+            order.push_front(image(i, std::vector<uint8>(size_t(N * S))));
+
+            uint8 *p = &order.front().second.front();
+
+            for (tsize_t s = 0; s < N; ++s)
+                if (TIFFReadEncodedStrip(T, s, p + s * S, S) < 0)
+                    fail = true;
+
+            bytes += order.front().second.size();
+            j = pages.insert(std::make_pair(i, order.begin())).first;
+        }
+        else
+        {
+            fprintf(stderr, "Failed to read page %lld\n", i);
+            fail = true;
+
+            order.push_front(image(i, std::vector<uint8>(
+                                 size_t(n + 2) * (n + 2) * c * b / 8)));
+            j = pages.insert(std::make_pair(i, order.begin())).first;
+        }
+    }
+    else
+        order.splice(order.begin(), order, j->second);
+
+    return &j->second->second.front();
+}
+
+// Return sample k of the given page as a float.
+
+float below::value(const uint8 *p, size_t k) const
+{
+    switch (b)
+    {
+    case  8: return ((const uint8  *) p)[k];
+    case 16: return ((const uint16 *) p)[k];
+    default: return ((const float  *) p)[k];
+    }
+}
+
+// Give the pixel of this level nearest vector v. Vectors are located anew, so
+// that those beyond the edge of a root page find the neighboring root. The
+// batch form of scm_locate assigns vectors lying between roots to one of them.
+
+void below::get(const double *v, float *p)
+{
+    long long a;
+    double    y;
+    double    x;
+
+    scm_locate(&a, &y, &x, v, 1);
+
+    x = 1 - x;
+
+    const long long N = (1LL << l) * n;
+    const long long Y = std::max(0LL, std::min(N - 1, (long long) (y * N)));
+    const long long X = std::max(0LL, std::min(N - 1, (long long) (x * N)));
+
+    const uint8 *P = page(scm_page_index(a, l, Y / n, X / n));
+    const size_t o = (size_t(Y % n + 1) * (n + 2) + size_t(X % n + 1)) * c;
+
+    for (int d = 0; d < c; ++d)
+        p[d] = value(P, o + d);
+}
+
+//------------------------------------------------------------------------------
+
+// A page is the compressed result of one work item, with its extrema.
+
+struct page
+{
+    std::vector<uint8>  data;
+    std::vector<uint64> size;
+    std::vector<float>  min;
+    std::vector<float>  max;
+};
+
+// The build state is shared by all threads.
+
+struct build
+{
+    const char *name;
+    const char *out;
+    size_t      budget;
+    int         n;
+    int         c;
+    int         b;
+    int         depth;
+    int         level;
+
+    std::vector<long long> order;   // Page indices of this level in write order
+    std::vector<uint64>    offset;  // Page offsets by index, of finished levels
+    std::vector<TIFF *>    input;   // Output handles for reading finished levels
+    size_t                 start;   // Next input handle to be taken
+    size_t                 next;    // Next page to be processed
+    std::map<size_t, page> done;    // Processed pages awaiting write
+    bool                   fail;
+
+    SDL_mutex *mutex;
+    SDL_cond  *ready;
+    SDL_sem   *room;
+};
+
+// Sample page i from S into buffer P, an n+2 square with a one pixel border,
+// averaging k-by-k subsamples of each pixel, and note its per-channel extrema.
+
+template <typename S>
+static void make_page(S& s, long long i, int k, int n, int c, int b,
+                      std::vector<uint8>& P, page& R)
+{
+    long long a, l, r, q;
+
+    scm_page_decode(i, a, l, r, q);
+
+    const double N = double(1LL << l);
+    const int    m = n + 2;
+    const int    e = m * k * k;
+
+    std::vector<long long> A(e, a);
+    std::vector<double>    Y(e);
+    std::vector<double>    X(e);
+    std::vector<double>    V(e * 3);
+    std::vector<float>     f(c);
+    std::vector<double>    t(c);
+
+    R.min.assign(c,  HUGE_VAL);
+    R.max.assign(c, -HUGE_VAL);
+
+    for (int y = 0; y < m; ++y)
+    {
+        // Compute the vectors of all subsamples of this row at once.
+
+        for (int x = 0, j = 0; x < m; ++x)
+            for (int u = 0; u < k; ++u)
+                for (int w = 0; w < k; ++w, ++j)
+                {
+                    Y[j] = (r + (y - 1 + (u + 0.5) / k) / n) / N;
+                    X[j] = (q + (x - 1 + (w + 0.5) / k) / n) / N;
+                }
+
+        scm_vector(&A.front(), &Y.front(), &X.front(), &V.front(), e);
+
+        // Average the subsamples of each pixel.
+
+        for (int x = 0; x < m; ++x)
+        {
+            std::fill(t.begin(), t.end(), 0.0);
+
+            for (int j = 0; j < k * k; ++j)
+            {
+                s.get(&V[3 * (x * k * k + j)], &f.front());
+
+                for (int d = 0; d < c; ++d)
+                    t[d] += f[d];
+            }
+
+            for (int d = 0; d < c; ++d)
+            {
+                const size_t o = (size_t(y) * m + x) * c + d;
+
+                // Quantize the sample, noting the extrema of the stored value.
+
+                double v = t[d] / (k * k);
+
+                switch (b)
+                {
+                case  8: v = floor(std::max(0.0, std::min(  255.0, v + 0.5)));
+                         P[o] = uint8(v);
+                         break;
+                case 16: v = floor(std::max(0.0, std::min(65535.0, v + 0.5)));
+                         ((uint16 *) &P.front())[o] = uint16(v);
+                         break;
+                default: ((float  *) &P.front())[o] = float(v);
+                         break;
+                }
+
+                R.min[d] = std::min(R.min[d], float(v));
+                R.max[d] = std::max(R.max[d], float(v));
+            }
+        }
+    }
+}
+
+// Process pages of the current level from S, averaging k-by-k subsamples per
+// pixel, until none remain. Work is limited by the room available for pages
+// awaiting write. On failure, flag it and wake the writer.
+
+template <typename S>
+static void work(build *B, S& s, int k)
+{
+    std::vector<uint8> P(size_t(B->n + 2) * (B->n + 2) * B->c * B->b / 8);
+
+    while (s.ok())
+    {
+        SDL_SemWait(B->room);
+        SDL_LockMutex(B->mutex);
+
+        size_t j = B->next++;
+        bool   f = B->fail;
+
+        SDL_UnlockMutex(B->mutex);
+
+        if (j >= B->order.size() || f)
+            return;
+
+        page R;
+
+        make_page(s, B->order[j], k, B->n, B->c, B->b, P, R);
+
+        bool ok = s.ok() && scm_deflate_page(B->n + 2, B->n + 2, B->c, B->b,
+                                             &P.front(), R.data, R.size);
+
+        SDL_LockMutex(B->mutex);
+        {
+            if (!ok) B->fail = true;
+            B->done[j].data.swap(R.data);
+            B->done[j].size.swap(R.size);
+            B->done[j].min .swap(R.min);
+            B->done[j].max .swap(R.max);
+        }
+        SDL_CondBroadcast(B->ready);
+        SDL_UnlockMutex(B->mutex);
+    }
+
+    SDL_LockMutex(B->mutex);
+    B->fail = true;
+    SDL_CondBroadcast(B->ready);
+    SDL_UnlockMutex(B->mutex);
+}
+
+// Worker thread. Resample the deepest level from the source, with supersampling
+// matched to the source pixels per page pixel. Reduce each coarser level from
+// the finished level below it, each pixel being the average of the four pixels
+// beneath it.
+
+static int worker(void *data)
+{
+    build *B = (build *) data;
+
+    if (B->level == B->depth)
+    {
+        source S(B->name, B->budget);
+
+        const double N = double(1LL << B->depth);
+        const double K = ceil(S.W / (4.0 * B->n * N));
+        const int    k = std::max(1, std::min(4, int(K)));
+
+        work(B, S, k);
+    }
+    else
+    {
+        SDL_LockMutex(B->mutex);
+        TIFF *T = B->input[B->start++];
+        SDL_UnlockMutex(B->mutex);
+
+        below S(T, B->offset, B->level + 1, B->n, B->c, B->b, B->budget);
+
+        work(B, S, 2);
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Store extremum f of page k, channel d, in catalog array v of b-bit samples.
+
+static void extremum(std::vector<uint8>& v, size_t k, int b, float f)
+{
+    switch (b)
+    {
+    case  8: v[k] = uint8(f + 0.5f); break;
+    case 16: ((uint16 *) &v.front())[k] = uint16(f + 0.5f); break;
+    default: ((float  *) &v.front())[k] = f; break;
+    }
+}
+
+struct entry
+{
+    long long l, a, d, i;
+
+    bool operator<(const entry& that) const
+    {
+        if (l != that.l) return l < that.l;
+        if (a != that.a) return a < that.a;
+        return d < that.d;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    int    n = 512;
+    int    d = 4;
+    int    t = 4;
+    size_t m = 256;
+    int    k;
+
+    for (k = 1; k + 1 < argc && argv[k][0] == '-'; k += 2)
+    {
+        if      (strcmp(argv[k], "-n") == 0) n = atoi(argv[k + 1]);
+        else if (strcmp(argv[k], "-d") == 0) d = atoi(argv[k + 1]);
+        else if (strcmp(argv[k], "-t") == 0) t = atoi(argv[k + 1]);
+        else if (strcmp(argv[k], "-m") == 0) m = atoi(argv[k + 1]);
+    }
+
+    if (k + 2 != argc || n < 1 || d < 0 || t < 1)
+    {
+        fprintf(stderr, "Usage: %s [-n size] [-d depth] [-t threads] "
+                        "[-m megabytes] in.tif out.tif\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Determine the source format.
+
+    build B;
+
+    {
+        source S(argv[k], 0);
+
+        if (!S.ok())
+            return EXIT_FAILURE;
+
+        B.c = S.C;
+        B.b = S.B;
+    }
+
+    B.name   = argv[k];
+    B.out    = argv[k + 1];
+    B.budget = (m << 20) / t;
+    B.n      = n;
+    B.depth  = d;
+    B.level  = d;
+    B.start  = 0;
+    B.next   = 0;
+    B.fail   = false;
+    B.mutex  = SDL_CreateMutex();
+    B.ready  = SDL_CreateCond();
+    B.room   = 0;
+
+    // Order all pages by level, root, and curve.
+
+    std::vector<entry> E(size_t(scm_page_count(d)));
+
+    for (long long i = 0; i < (long long) E.size(); ++i)
+    {
+        long long r, q;
+
+        scm_page_decode(i, E[i].a, E[i].l, r, q);
+
+        E[i].d = scm_hilbert(E[i].l, r, q);
+        E[i].i = i;
+    }
+
+    std::sort(E.begin(), E.end());
+
+    // Build each level from the deepest up, launching the workers and writing
+    // pages as they complete, in order. The output is closed after each level
+    // so that the workers of the next may read it.
+
+    const size_t C = size_t(B.c);
+
+    std::vector<uint64> x(E.size());
+    std::vector<float>  lo(E.size() * C);
+    std::vector<float>  hi(E.size() * C);
+
+    B.offset.assign(E.size(), 0);
+
+    size_t count = 0;
+
+    for (int l = d; l >= 0 && !B.fail; --l)
+    {
+        B.order.clear();
+
+        for (size_t j = 0; j < E.size(); ++j)
+            if (E[j].l == l)
+                B.order.push_back(E[j].i);
+
+        B.level = l;
+        B.start = 0;
+        B.next  = 0;
+        B.room  = SDL_CreateSemaphore(4 * t);
+
+        B.input.assign(size_t(t), (TIFF *) 0);
+
+        if (l < d)
+            for (int j = 0; j < t; ++j)
+                B.input[j] = TIFFOpen(B.out, "r");
+
+        std::vector<SDL_Thread *> threads;
+
+        for (int j = 0; j < t; ++j)
+            threads.push_back(SDL_CreateThread(worker, "scmbuild", &B));
+
+        TIFF *T = TIFFOpen(B.out, (l == d) ? "w8" : "a");
+
+        for (size_t j = 0; T && j < B.order.size(); ++j)
+        {
+            page R;
+            bool f;
+
+            SDL_LockMutex(B.mutex);
+            {
+                while (!(f = B.fail) && B.done.find(j) == B.done.end())
+                    SDL_CondWait(B.ready, B.mutex);
+
+                if (!f)
+                {
+                    page& D = B.done[j];
+
+                    R.data.swap(D.data);
+                    R.size.swap(D.size);
+                    R.min .swap(D.min);
+                    R.max .swap(D.max);
+
+                    B.done.erase(j);
+                }
+            }
+            SDL_UnlockMutex(B.mutex);
+
+            if (f) break;
+
+            SDL_SemPost(B.room);
+
+            const size_t i = size_t(B.order[j]);
+
+            x[i] = uint64(i);
+
+            bool ok = scm_append_page(T, n + 2, n + 2, B.c, B.b,
+                                      R.data, R.size, B.offset[i]);
+
+            for (size_t c = 0; c < C; ++c)
+            {
+                lo[i * C + c] = R.min[c];
+                hi[i * C + c] = R.max[c];
+            }
+
+            if (!ok)
+            {
+                SDL_LockMutex(B.mutex);
+                B.fail = true;
+                SDL_UnlockMutex(B.mutex);
+                break;
+            }
+
+            if (++count % 1000 == 0)
+                printf("%lu of %lu pages\n", (unsigned long) count,
+                                             (unsigned long) E.size());
+        }
+
+        if (T)
+            TIFFClose(T);
+        else
+            B.fail = true;
+
+        // Release the workers, should any remain.
+
+        SDL_LockMutex(B.mutex);
+        B.next = B.order.size();
+        SDL_UnlockMutex(B.mutex);
+
+        for (int j = 0; j < t; ++j)
+            SDL_SemPost(B.room);
+
+        for (int j = 0; j < t; ++j)
+            SDL_WaitThread(threads[j], 0);
+
+        SDL_DestroySemaphore(B.room);
+        B.done.clear();
+    }
+
+    SDL_DestroyCond (B.ready);
+    SDL_DestroyMutex(B.mutex);
+
+    if (B.fail)
+    {
+        fprintf(stderr, "%s: build failed\n", B.out);
+        return EXIT_FAILURE;
+    }
+
+    // Merge the extrema of each page into its parent, deepest first, so that
+    // the extrema of a page bound all of its descendants. Deeper pages have
+    // greater indices.
+
+    for (size_t i = E.size(); i-- > 6; )
+    {
+        const size_t p = size_t(scm_page_parent((long long) i));
+
+        for (size_t c = 0; c < C; ++c)
+        {
+            lo[p * C + c] = std::min(lo[p * C + c], lo[i * C + c]);
+            hi[p * C + c] = std::max(hi[p * C + c], hi[i * C + c]);
+        }
+    }
+
+    std::vector<uint8> a(E.size() * C * B.b / 8);
+    std::vector<uint8> z(E.size() * C * B.b / 8);
+
+    for (size_t j = 0; j < E.size() * C; ++j)
+    {
+        extremum(a, j, B.b, lo[j]);
+        extremum(z, j, B.b, hi[j]);
+    }
+
+    // Write the catalog.
+
+    if (TIFF *T = TIFFOpen(B.out, "r+"))
+    {
+        bool ok = scm_write_catalog(T, &x.front(), &B.offset.front(),
+                                       &a.front(), &z.front(), x.size(),
+                                       B.c, B.b);
+        TIFFClose(T);
+
+        if (ok) return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
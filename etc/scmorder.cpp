@@ -0,0 +1,163 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmorder rewrites an SCM TIFF with its pages ordered level by level, root by
+// root, and along a Hilbert curve within each root, so that pages neighboring
+// on the sphere are neighbors in the file. Compressed page data is copied
+// without decoding and the catalog is rebuilt with the new offsets.
+//
+//     scmorder input.tif output.tif
+//
+// As a measure of read locality, the total distance in the file between pages
+// visited in curve order is reported before and after.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "../scm-index.hpp"
+#include "../scm-write.hpp"
+
+//------------------------------------------------------------------------------
+
+struct entry
+{
+    long long l;  // Page level
+    long long a;  // Page root
+    long long d;  // Page curve distance
+    uint64    k;  // Catalog index
+
+    bool operator<(const entry& that) const
+    {
+        if (l != that.l) return l < that.l;
+        if (a != that.a) return a < that.a;
+        return d < that.d;
+    }
+};
+
+// Sum the distances between consecutive non-empty pages of the given order.
+
+static double span(const std::vector<entry>& E, const std::vector<uint64>& o)
+{
+    double s = 0;
+    uint64 p = 0;
+
+    for (size_t k = 0; k < E.size(); ++k)
+        if (uint64 q = o[E[k].k])
+        {
+            if (p) s += (q > p) ? double(q - p) : double(p - q);
+            p = q;
+        }
+
+    return s;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s input.tif output.tif\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    TIFF *U = TIFFOpen(argv[1], "r");
+    TIFF *T = 0;
+
+    if (U == 0)
+        return EXIT_FAILURE;
+
+    uint16 c = 0;
+    uint16 b = 0;
+
+    TIFFGetField(U, TIFFTAG_BITSPERSAMPLE,   &b);
+    TIFFGetField(U, TIFFTAG_SAMPLESPERPIXEL, &c);
+
+    // Read the catalog.
+
+    std::vector<uint64> x;
+    std::vector<uint64> o;
+    std::vector<uint8>  a;
+    std::vector<uint8>  z;
+
+    if (!scm_read_catalog(U, x, o, a, z))
+    {
+        fprintf(stderr, "%s: missing page catalog\n", argv[1]);
+        TIFFClose(U);
+        return EXIT_FAILURE;
+    }
+
+    // Order the pages by level, root, and curve.
+
+    std::vector<entry> E(x.size());
+
+    for (size_t k = 0; k < x.size(); ++k)
+    {
+        long long r;
+        long long q;
+
+        scm_page_decode((long long) x[k], E[k].a, E[k].l, r, q);
+
+        E[k].d = scm_hilbert(E[k].l, r, q);
+        E[k].k = k;
+    }
+
+    std::sort(E.begin(), E.end());
+
+    // Copy the pages in order.
+
+    std::vector<uint64> O(o.size(), 0);
+
+    bool ok = false;
+
+    if ((T = TIFFOpen(argv[2], "w8")))
+    {
+        ok = true;
+
+        for (size_t k = 0; ok && k < E.size(); ++k)
+            if (o[E[k].k])
+            {
+                if (!scm_copy_page(T, U, o[E[k].k], O[E[k].k]))
+                {
+                    fprintf(stderr, "%s: failed to copy page %lld\n", argv[1],
+                                                    (long long) x[E[k].k]);
+                    ok = false;
+                }
+            }
+        TIFFClose(T);
+    }
+    TIFFClose(U);
+
+    // Write the new catalog.
+
+    if (ok)
+    {
+        ok = false;
+
+        if ((T = TIFFOpen(argv[2], "r+")))
+        {
+            ok = scm_write_catalog(T, &x.front(), &O.front(),
+                                      &a.front(), &z.front(), x.size(), c, b);
+            TIFFClose(T);
+        }
+    }
+
+    if (!ok)
+        return EXIT_FAILURE;
+
+    printf("%lu pages, curve-order span %.1f MB before, %.1f MB after\n",
+           (unsigned long) x.size(), span(E, o) / 1048576.0,
+                                     span(E, O) / 1048576.0);
+    return EXIT_SUCCESS;
+}
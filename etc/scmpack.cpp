@@ -0,0 +1,258 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmpack converts an SCM TIFF to an SCM pack without loss. Each page is
+// decoded and stored whole, deflated unless -r is given or deflate does not
+// help, at a page-aligned offset. Pages retain their order in the file.
+//
+//     scmpack [-r] input.tif output.scmp
+//
+// After conversion the time to open each file and read its catalog, and the
+// throughput of loading every page of each, are reported. Times are processor
+// times, and the input will likely be in the OS file cache, so this measures
+// the cost of parsing and decoding rather than that of the disk.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+#include "../scm-pack.hpp"
+#include "../scm-write.hpp"
+
+//------------------------------------------------------------------------------
+
+static double now()
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+// Read and decode the page at offset o of TIFF T into buffer p.
+
+static bool read(TIFF *T, uint64 o, uint8 *p)
+{
+    if (TIFFSetSubDirectory(T, o))
+    {
+        tsize_t N = TIFFNumberOfStrips(T);
+        tsize_t S = TIFFStripSize     (T);
+
+        for (tsize_t s = 0; s < N; ++s)
+            if (TIFFReadEncodedStrip(T, s, p + s * S, -1) == -1)
+                return false;
+
+        return true;
+    }
+    return false;
+}
+
+// Pad file f, currently of length o, with zeros to the next multiple of the
+// pack alignment. Return the resulting offset.
+
+static uint64 align(FILE *f, uint64& o)
+{
+    while (o % scm_pack_align)
+    {
+        fputc(0, f);
+        o++;
+    }
+    return o;
+}
+
+//------------------------------------------------------------------------------
+
+// Time opening TIFF name and reading its catalog, and loading all of its pages.
+
+static void bench_tiff(const char *name, size_t m, double& t0, double& t1)
+{
+    std::vector<uint64> x;
+    std::vector<uint64> o;
+    std::vector<uint8>  a;
+    std::vector<uint8>  z;
+    std::vector<uint8>  p(m);
+
+    double t = now();
+
+    if (TIFF *T = TIFFOpen(name, "r"))
+    {
+        scm_read_catalog(T, x, o, a, z);
+
+        t0 = now() - t;
+
+        for (size_t k = 0; k < x.size(); ++k)
+            if (o[k]) read(T, o[k], &p.front());
+
+        t1 = now() - t;
+
+        TIFFClose(T);
+    }
+}
+
+// Time opening pack name and reading its catalog, and loading all of its pages.
+
+static void bench_pack(const char *name, size_t m, double& t0, double& t1)
+{
+    std::vector<uint8> p(m);
+
+    double t = now();
+    {
+        scm_pack P(name);
+
+        t0 = now() - t;
+
+        for (uint64 k = 0; k < P.get_n(); ++k)
+            if (P.get_o()[k]) P.load(P.get_o()[k], &p.front());
+    }
+    t1 = now() - t;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    bool r = false;
+    int  i = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-r") == 0)
+    {
+        r = true;
+        i = 2;
+    }
+    if (argc - i != 2)
+    {
+        fprintf(stderr, "Usage: %s [-r] input.tif output.scmp\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *in  = argv[i + 0];
+    const char *out = argv[i + 1];
+
+    TIFF *T = TIFFOpen(in, "r");
+    FILE *F = 0;
+
+    if (T == 0)
+        return EXIT_FAILURE;
+
+    // Read the catalog.
+
+    std::vector<uint64> x;
+    std::vector<uint64> o;
+    std::vector<uint8>  a;
+    std::vector<uint8>  z;
+
+    if (!scm_read_catalog(T, x, o, a, z))
+    {
+        fprintf(stderr, "%s: missing page catalog\n", in);
+        TIFFClose(T);
+        return EXIT_FAILURE;
+    }
+
+    scm_pack_header H;
+
+    memset(&H, 0, sizeof (H));
+    memcpy(H.magic, "SCMPACK", 8);
+
+    H.version = 1;
+    H.n       = x.size();
+
+    TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &H.w);
+    TIFFGetField(T, TIFFTAG_IMAGELENGTH,     &H.h);
+    TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &H.b);
+    TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &H.c);
+
+    const size_t m = size_t(H.w) * H.h * H.c * H.b / 8;
+
+    // Visit the pages in file order, so that any locality is retained.
+
+    std::vector<std::pair<uint64, size_t> > E;
+
+    for (size_t k = 0; k < x.size(); ++k)
+        if (o[k]) E.push_back(std::make_pair(o[k], k));
+
+    std::sort(E.begin(), E.end());
+
+    std::vector<uint64> O(x.size(), 0);
+    std::vector<uint64> S(x.size(), 0);
+    std::vector<uint8>  C(x.size(), scm_pack_raw);
+
+    std::vector<uint8> p(m);
+    std::vector<uint8> q;
+
+    if ((F = fopen(out, "wb")))
+    {
+        uint64 f = fwrite(&H, 1, sizeof (H), F);
+
+        for (size_t e = 0; e < E.size(); ++e)
+        {
+            const size_t k = E[e].second;
+
+            if (!read(T, o[k], &p.front()))
+            {
+                fprintf(stderr, "%s: failed to read page %lld\n", in,
+                                                      (long long) x[k]);
+                TIFFClose(T);
+                fclose(F);
+                return EXIT_FAILURE;
+            }
+
+            C[k] = uint8(scm_pack_page(H.w, H.h, H.c, H.b, &p.front(), !r, q));
+            O[k] = align(F, f);
+            S[k] = q.size();
+
+            f += fwrite(&q.front(), 1, q.size(), F);
+        }
+
+        // Write the page table and complete the header.
+
+        H.t = align(F, f);
+
+        fwrite(&x.front(), sizeof (uint64), x.size(), F);
+        fwrite(&O.front(), sizeof (uint64), O.size(), F);
+        fwrite(&S.front(), sizeof (uint64), S.size(), F);
+        fwrite(&a.front(), 1,               a.size(), F);
+        fwrite(&z.front(), 1,               z.size(), F);
+        fwrite(&C.front(), 1,               C.size(), F);
+
+        fseek (F, 0, SEEK_SET);
+        fwrite(&H, sizeof (H), 1, F);
+
+        if (fclose(F))
+        {
+            TIFFClose(T);
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        TIFFClose(T);
+        return EXIT_FAILURE;
+    }
+
+    TIFFClose(T);
+
+    // Compare the two.
+
+    double ta0 = 0, ta1 = 0;
+    double tb0 = 0, tb1 = 0;
+
+    bench_tiff(in,  m, ta0, ta1);
+    bench_pack(out, m, tb0, tb1);
+
+    const double M = double(E.size()) * m / 1048576.0;
+
+    printf("%lu pages\n", (unsigned long) E.size());
+    printf("TIFF open %8.3f ms, load %8.1f MB/s\n", ta0 * 1000, M / ta1);
+    printf("pack open %8.3f ms, load %8.1f MB/s\n", tb0 * 1000, M / tb1);
+
+    return EXIT_SUCCESS;
+}
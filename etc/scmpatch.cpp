@@ -0,0 +1,150 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmpatch updates an SCM TIFF in place with the pages of another. Each page
+// of the patch is appended to the target, replacing any page of the same index
+// or adding it if new. Only the catalog of the target is rewritten, with the
+// extrema of the patched pages and their ancestors recomputed. Compressed page
+// data is copied without decoding.
+//
+//     scmpatch target.tif patch.tif
+//
+// The patch must have the same page size, channel count, and sample depth as
+// the target. A running application may observe the change by reloading the
+// target's catalog. @see scm_system::reload_scm
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../scm-write.hpp"
+
+//------------------------------------------------------------------------------
+
+// Return true if TIFFs T and U have the same image format.
+
+static bool match(TIFF *T, TIFF *U)
+{
+    uint32 tw = 0, th = 0, uw = 0, uh = 0;
+    uint16 tc = 0, tb = 0, uc = 0, ub = 0;
+
+    TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &tw);
+    TIFFGetField(T, TIFFTAG_IMAGELENGTH,     &th);
+    TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &tb);
+    TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &tc);
+
+    TIFFGetField(U, TIFFTAG_IMAGEWIDTH,      &uw);
+    TIFFGetField(U, TIFFTAG_IMAGELENGTH,     &uh);
+    TIFFGetField(U, TIFFTAG_BITSPERSAMPLE,   &ub);
+    TIFFGetField(U, TIFFTAG_SAMPLESPERPIXEL, &uc);
+
+    return (tw == uw && th == uh && tc == uc && tb == ub);
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s target.tif patch.tif\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    TIFF *U = TIFFOpen(argv[2], "r");
+    TIFF *T = 0;
+
+    if (U == 0)
+        return EXIT_FAILURE;
+
+    // Read the patch catalog.
+
+    std::vector<uint64> x;
+    std::vector<uint64> o;
+    std::vector<uint8>  a;
+    std::vector<uint8>  z;
+
+    if (!scm_read_catalog(U, x, o, a, z))
+    {
+        fprintf(stderr, "%s: missing page catalog\n", argv[2]);
+        TIFFClose(U);
+        return EXIT_FAILURE;
+    }
+
+    // Append each page of the patch to the target. Should any fail, leave the
+    // target catalog as it was, so that the appended pages go unreferenced.
+
+    std::vector<uint64> i;
+    std::vector<uint64> O;
+
+    bool ok = false;
+
+    if ((T = TIFFOpen(argv[1], "r")))
+    {
+        ok = match(T, U);
+
+        TIFFClose(T);
+
+        if (!ok)
+            fprintf(stderr, "%s: format does not match %s\n", argv[2], argv[1]);
+    }
+
+    if (ok)
+    {
+        ok = false;
+
+        if ((T = TIFFOpen(argv[1], "a")))
+        {
+            ok = true;
+
+            for (size_t k = 0; ok && k < x.size(); ++k)
+                if (o[k])
+                {
+                    uint64 q = 0;
+
+                    if (scm_copy_page(T, U, o[k], q))
+                    {
+                        i.push_back(x[k]);
+                        O.push_back(q);
+                    }
+                    else
+                    {
+                        fprintf(stderr, "%s: failed to copy page %lld\n",
+                                        argv[2], (long long) x[k]);
+                        ok = false;
+                    }
+                }
+            TIFFClose(T);
+        }
+    }
+    TIFFClose(U);
+
+    // Patch the target catalog.
+
+    if (ok)
+    {
+        ok = false;
+
+        if ((T = TIFFOpen(argv[1], "r+")))
+        {
+            ok = scm_patch_catalog(T, i, O);
+            TIFFClose(T);
+        }
+    }
+
+    if (!ok)
+        return EXIT_FAILURE;
+
+    printf("%lu pages patched\n", (unsigned long) i.size());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,407 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmstat validates an SCM TIFF or SCM pack and reports its statistics. Every
+// page in the catalog is read and decoded by several threads, visiting pages
+// in file order. Each page must decode with the expected format and lie within
+// the extrema given by the catalog. The catalog must be sorted, and each page
+// must have a parent. For an SCM TIFF, the directory chain is walked to find
+// catalog pages absent from the chain and directories absent from the catalog.
+// These are noted but are not errors. Rewriting the catalog moves the first
+// directory, leaving the first page unlinked, and patching pages leaves the
+// replaced pages unreferenced.
+//
+//     scmstat [-t threads] file
+//
+// The report is written to standard output as JSON, with the page count, raw
+// size, and stored size of each level. The exit status is nonzero if any error
+// is found.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "../scm-index.hpp"
+#include "../scm-file.hpp"
+
+//------------------------------------------------------------------------------
+
+// The result of the scan of one catalog entry.
+
+struct result
+{
+    result() : mesg(0), bounds(true), exact(true), size(0) { }
+
+    const char *mesg;    // Read failure, or null
+    bool        bounds;  // Page lies within its catalog extrema
+    bool        exact;   // Page extrema equal its catalog extrema
+    uint64      size;    // Stored size
+};
+
+// The scan state is shared by all threads.
+
+struct scan
+{
+    scm_file *file;
+
+    std::vector<uint64> order;   // Catalog entries in file order
+    std::vector<uint64> offset;  // Offset of each catalog entry
+    std::vector<result> R;       // Result of each catalog entry
+    size_t              next;    // Next entry of the order to be scanned
+
+    SDL_mutex *mutex;
+};
+
+// Return sample k of page buffer p of b-bit samples, as the catalog gives it.
+
+static float sample(const uint8 *p, size_t k, int b)
+{
+    switch (b)
+    {
+    case  8: return ((const uint8  *) p)[k] /   255.f;
+    case 16: return ((const uint16 *) p)[k] / 65535.f;
+    default: return ((const float  *) p)[k];
+    }
+}
+
+// Return the stored size of the current directory of T.
+
+static uint64 stored(TIFF *T)
+{
+    uint64 *v = 0;
+    uint64  s = 0;
+
+    if (TIFFGetField(T, TIFFTAG_STRIPBYTECOUNTS, &v) && v)
+        for (tstrip_t k = 0; k < TIFFNumberOfStrips(T); ++k)
+            s += v[k];
+
+    return s;
+}
+
+// Scan catalog entry k using TIFF T or the pack of the file, with page buffer p.
+
+static void check(scan& S, TIFF *T, uint64 k, std::vector<uint8>& p)
+{
+    const int w = int(S.file->get_w());
+    const int h = int(S.file->get_h());
+    const int c = int(S.file->get_c());
+    const int b = int(S.file->get_b());
+
+    const scm_pack *P = S.file->get_pack();
+    const uint64    o = S.offset[k];
+
+    result r;
+
+    if (P)
+        r.mesg = scm_read_page(P, o, w, h, c, b, &p.front());
+    else
+        r.mesg = scm_read_page(T, o, w, h, c, b, &p.front());
+
+    if (r.mesg == 0)
+    {
+        std::vector<float> a(c), z(c), lo(c, 0.f), hi(c, 0.f);
+
+        S.file->get_page_range(k, &a.front(), &z.front());
+
+        for (int d = 0; d < c; ++d)
+        {
+            lo[d] = hi[d] = sample(&p.front(), d, b);
+
+            for (size_t j = d; j < size_t(w) * h * c; j += c)
+            {
+                const float v = sample(&p.front(), j, b);
+
+                lo[d] = std::min(lo[d], v);
+                hi[d] = std::max(hi[d], v);
+            }
+
+            if (lo[d] < a[d] || hi[d] > z[d]) r.bounds = false;
+            if (lo[d] != a[d] || hi[d] != z[d]) r.exact = false;
+        }
+
+        r.size = P ? P->get_s()[k] : stored(T);
+    }
+
+    S.R[k] = r;
+}
+
+// Scan worker thread. Take entries in batches until none remain.
+
+static int worker(void *data)
+{
+    scan& S = *((scan *) data);
+
+    const size_t m = size_t(S.file->get_w()) * S.file->get_h()
+                   * size_t(S.file->get_c()) * S.file->get_b() / 8;
+
+    std::vector<uint8> p(m);
+
+    TIFF *T = S.file->get_pack() ? 0 : TIFFOpen(S.file->get_path(), "r");
+
+    while (true)
+    {
+        size_t j0, j1;
+
+        SDL_LockMutex(S.mutex);
+        {
+            j0 = S.next;
+            j1 = S.next = std::min(S.order.size(), S.next + 64);
+        }
+        SDL_UnlockMutex(S.mutex);
+
+        if (j0 == j1)
+            break;
+
+        for (size_t j = j0; j < j1; ++j)
+            check(S, T, S.order[j], p);
+    }
+
+    if (T) TIFFClose(T);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Walk the directory chain of the named TIFF, giving the offset of each after
+// the first, which carries the catalog.
+
+static void chain(const char *name, std::vector<uint64>& v)
+{
+    if (TIFF *T = TIFFOpen(name, "r"))
+    {
+        while (TIFFReadDirectory(T))
+            v.push_back(TIFFCurrentDirOffset(T));
+
+        TIFFClose(T);
+    }
+    std::sort(v.begin(), v.end());
+}
+
+// Per-level statistics.
+
+struct level
+{
+    level() : pages(0), raw(0), size(0) { }
+
+    uint64 pages;
+    uint64 raw;
+    uint64 size;
+};
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    int t = SDL_GetCPUCount();
+    int k;
+
+    for (k = 1; k < argc - 1 && argv[k][0] == '-'; k += 2)
+    {
+        if (strcmp(argv[k], "-t") == 0) t = atoi(argv[k + 1]);
+    }
+
+    if (k + 1 != argc || t < 1)
+    {
+        fprintf(stderr, "Usage: %s [-t threads] file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *name = argv[k];
+
+    scm_file file(name, name);
+
+    const uint64 n = file.get_page_count();
+
+    if (n == 0)
+    {
+        fprintf(stderr, "%s: missing page catalog\n", name);
+        return EXIT_FAILURE;
+    }
+
+    // Check the order and structure of the catalog.
+
+    uint64 unsorted = 0;
+    uint64 orphaned = 0;
+    uint64 absent   = 0;
+
+    scan S;
+
+    S.file  = &file;
+    S.next  = 0;
+    S.mutex = SDL_CreateMutex();
+    S.R.resize(size_t(n));
+
+    std::vector<std::pair<uint64, uint64> > E;
+
+    for (uint64 j = 0; j < n; ++j)
+    {
+        const uint64 i = file.get_page_index(j);
+        const uint64 o = file.get_page_offset(i);
+
+        if (j > 0 && i <= file.get_page_index(j - 1))
+            unsorted++;
+
+        if (i >= 6 && !file.get_page_status(uint64(scm_page_parent((long long) i))))
+            orphaned++;
+
+        S.offset.push_back(o);
+
+        if (o)
+            E.push_back(std::make_pair(o, j));
+        else
+            absent++;
+    }
+
+    std::sort(E.begin(), E.end());
+
+    for (size_t j = 0; j < E.size(); ++j)
+        S.order.push_back(E[j].second);
+
+    // Scan all pages, walking the directory chain in the mean time.
+
+    const Uint32 t0 = SDL_GetTicks();
+
+    std::vector<SDL_Thread *> threads;
+    std::vector<uint64>       dirs;
+
+    for (int j = 0; j < t; ++j)
+        threads.push_back(SDL_CreateThread(worker, "scmstat", &S));
+
+    if (!file.get_pack())
+        chain(name, dirs);
+
+    for (int j = 0; j < t; ++j)
+        SDL_WaitThread(threads[j], 0);
+
+    const Uint32 t1 = SDL_GetTicks();
+
+    SDL_DestroyMutex(S.mutex);
+
+    // Compare the catalog with the directory chain.
+
+    uint64 unlinked     = 0;
+    uint64 unreferenced = 0;
+
+    if (!file.get_pack())
+    {
+        for (size_t j = 0; j < E.size(); ++j)
+            if (!std::binary_search(dirs.begin(), dirs.end(), E[j].first))
+                unlinked++;
+
+        for (size_t j = 0; j < dirs.size(); ++j)
+        {
+            std::vector<std::pair<uint64, uint64> >::iterator i;
+
+            i = std::lower_bound(E.begin(), E.end(),
+                                 std::make_pair(dirs[j], uint64(0)));
+
+            if (i == E.end() || i->first != dirs[j])
+                unreferenced++;
+        }
+    }
+
+    // Tally the results.
+
+    const uint64 m = uint64(file.get_w()) * file.get_h()
+                   * file.get_c() * file.get_b() / 8;
+
+    std::vector<level> L;
+
+    uint64 failed = 0;
+    uint64 bounds = 0;
+    uint64 loose  = 0;
+    uint64 bytes  = 0;
+
+    for (size_t j = 0; j < S.order.size(); ++j)
+    {
+        const uint64  e = S.order[j];
+        const result& r = S.R[e];
+        const size_t  l = size_t(scm_page_level((long long) file.get_page_index(e)));
+
+        if (L.size() <= l)
+            L.resize(l + 1);
+
+        L[l].pages += 1;
+        L[l].raw   += m;
+        L[l].size  += r.size;
+        bytes      += r.size;
+
+        if (r.mesg)    failed++;
+        if (!r.bounds) bounds++;
+        if (!r.exact)  loose++;
+    }
+
+    // Report.
+
+    const double s = (t1 - t0) / 1000.0;
+
+    printf("{\n");
+    printf("  \"file\": \"%s\",\n", name);
+    printf("  \"format\": \"%s\",\n", file.get_pack() ? "pack" : "tiff");
+    printf("  \"page\": { \"width\": %u, \"height\": %u, "
+                         "\"channels\": %u, \"bits\": %u },\n",
+           (unsigned) file.get_w(), (unsigned) file.get_h(),
+           (unsigned) file.get_c(), (unsigned) file.get_b());
+    printf("  \"catalog\": { \"entries\": %llu, \"absent\": %llu, "
+                            "\"unsorted\": %llu, \"orphaned\": %llu, "
+                            "\"unlinked\": %llu, \"unreferenced\": %llu },\n",
+           (unsigned long long) n,        (unsigned long long) absent,
+           (unsigned long long) unsorted, (unsigned long long) orphaned,
+           (unsigned long long) unlinked, (unsigned long long) unreferenced);
+    printf("  \"pages\": { \"read\": %llu, \"failed\": %llu, "
+                          "\"bounds\": %llu, \"loose\": %llu },\n",
+           (unsigned long long) S.order.size(), (unsigned long long) failed,
+           (unsigned long long) bounds,         (unsigned long long) loose);
+    printf("  \"levels\": [\n");
+
+    for (size_t l = 0; l < L.size(); ++l)
+        printf("    { \"level\": %lu, \"pages\": %llu, \"raw\": %llu, "
+                     "\"stored\": %llu, \"ratio\": %.3f }%s\n",
+               (unsigned long) l,
+               (unsigned long long) L[l].pages,
+               (unsigned long long) L[l].raw,
+               (unsigned long long) L[l].size,
+               L[l].size ? double(L[l].raw) / double(L[l].size) : 0.0,
+               (l + 1 < L.size()) ? "," : "");
+
+    printf("  ],\n");
+    printf("  \"seconds\": %.3f,\n", s);
+    printf("  \"stored_mb_per_second\": %.1f,\n", s > 0 ? bytes / 1048576.0 / s : 0.0);
+    printf("  \"errors\": [");
+
+    bool first = true;
+
+    for (size_t j = 0; j < S.order.size(); ++j)
+    {
+        const uint64  e = S.order[j];
+        const result& r = S.R[e];
+
+        if (r.mesg || !r.bounds)
+        {
+            printf("%s\n    { \"index\": %llu, \"error\": \"%s\" }",
+                   first ? "" : ",",
+                   (unsigned long long) file.get_page_index(e),
+                   r.mesg ? r.mesg : "Page exceeds catalog extrema");
+            first = false;
+        }
+    }
+    printf("%s]\n}\n", first ? "" : "\n  ");
+
+    return (failed || bounds || unsorted || orphaned) ? EXIT_FAILURE
+                                                      : EXIT_SUCCESS;
+}
@@ -0,0 +1,974 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+// scmtest checks libscm against reference computations, some of them using
+// small synthetic SCM TIFFs written to the current directory and removed on
+// exit. It links the full library and requires an OpenGL context, which is
+// created with a hidden window. Each check reports its result on one line.
+//
+//     scmtest
+//
+// The exit status is nonzero if any check fails.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include "../scm-system.hpp"
+#include "../scm-sphere.hpp"
+#include "../scm-cache.hpp"
+#include "../scm-scene.hpp"
+#include "../scm-image.hpp"
+#include "../scm-index.hpp"
+#include "../scm-write.hpp"
+#include "../scm-task.hpp"
+#include "../scm-bcn.hpp"
+#include "../scm-set.hpp"
+
+//------------------------------------------------------------------------------
+
+// Synthetic pages are n-by-n plus gutter, with one 8-bit channel. An atlas line
+// of 16 divides evenly to four mipmap levels.
+
+static const int n = 14;
+
+// Report the result of the named check, returning true if it passed.
+
+static bool report(const char *name, bool ok, const char *mesg)
+{
+    if (ok)
+        printf("%-12s ok\n", name);
+    else
+        printf("%-12s FAIL %s\n", name, mesg);
+    return ok;
+}
+
+// Write an SCM TIFF with the given pages, each constant with the given value.
+// Page extrema are merged up the tree, as a builder would. The indices must be
+// sorted and each page must have a parent.
+
+static bool synth(const char *name, const std::vector<long long>& i,
+                                    const std::vector<uint8>&     k)
+{
+    const size_t m = i.size();
+    const size_t s = size_t(n + 2) * size_t(n + 2);
+
+    std::vector<uint64> x(m);
+    std::vector<uint64> o(m);
+    std::vector<uint8>  a(k);
+    std::vector<uint8>  z(k);
+    std::vector<uint8>  p(s);
+
+    bool ok = false;
+
+    if (TIFF *T = TIFFOpen(name, "w8"))
+    {
+        ok = true;
+
+        for (size_t j = 0; ok && j < m; ++j)
+        {
+            std::fill(p.begin(), p.end(), k[j]);
+
+            x[j] = uint64(i[j]);
+            ok   = scm_write_page(T, n + 2, n + 2, 1, 8, &p.front(), o[j]);
+        }
+        TIFFClose(T);
+    }
+
+    // Merge the extrema of each page into its ancestors, deepest first.
+
+    for (size_t j = m; ok && j-- > 0; )
+        if (i[j] >= 6)
+        {
+            const long long q = scm_page_parent(i[j]);
+
+            for (size_t l = 0; l < j; ++l)
+                if (i[l] == q)
+                {
+                    a[l] = std::min(a[l], a[j]);
+                    z[l] = std::max(z[l], z[j]);
+                }
+        }
+
+    if (ok)
+    {
+        ok = false;
+
+        if (TIFF *T = TIFFOpen(name, "r+"))
+        {
+            ok = scm_write_catalog(T, &x.front(), &o.front(),
+                                      &a.front(), &z.front(), m, 1, 8);
+            TIFFClose(T);
+        }
+    }
+    return ok;
+}
+
+// Request page i of file f in cache C and update the cache until the page is
+// resident, giving up after about a second. Return its atlas line, or 0.
+
+static int frame = 1;
+
+static int load(scm_cache *C, int f, long long i)
+{
+    for (int j = 0; j < 1000; ++j, ++frame)
+    {
+        int u;
+
+        C->get_page(f, i, frame, u, 1.0f, 0);
+        C->update(frame, true);
+
+        if (int l = C->find_page(f, i, frame, u))
+            return l;
+
+        SDL_Delay(1);
+    }
+    return 0;
+}
+
+// Return the number of texels of atlas line l of cache C at mipmap level j
+// that differ from value k.
+
+static int differ(scm_cache *C, int l, int j, GLubyte k)
+{
+    const int s = C->get_grid_size();
+    const int m = C->get_line_size();
+    const int M =  (s * m) >> j;
+    const int w =       m  >> j;
+    const int x = ((l % s) * m) >> j;
+    const int y = ((l / s) * m) >> j;
+
+    std::vector<GLubyte> p(size_t(M) * size_t(M));
+
+    glBindTexture(GL_TEXTURE_2D, C->get_texture());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, j, GL_RED, GL_UNSIGNED_BYTE, &p.front());
+
+    int e = 0;
+
+    for (int r = y; r < y + w; ++r)
+        for (int c = x; c < x + w; ++c)
+            if (p[size_t(r) * M + c] != k)
+                e++;
+
+    return e;
+}
+
+// Return a uniformly-distributed random unit vector.
+
+static void random_vector(double *v)
+{
+    double d;
+
+    do
+    {
+        v[0] = 2.0 * rand() / RAND_MAX - 1.0;
+        v[1] = 2.0 * rand() / RAND_MAX - 1.0;
+        v[2] = 2.0 * rand() / RAND_MAX - 1.0;
+    }
+    while ((d = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2])) > 1 || d < 1e-3);
+
+    v[0] /= d;
+    v[1] /= d;
+    v[2] /= d;
+}
+
+// Set M to the model-view-projection matrix of a square view with a 90-degree
+// field of view, looking at the origin from distance d along the z axis.
+
+static void look(double *M, double d)
+{
+    const double N = 0.01;
+    const double F = 100.0;
+
+    std::fill(M, M + 16, 0.0);
+
+    M[ 0] =  1.0;
+    M[ 5] =  1.0;
+    M[10] = (F + N) / (N - F);
+    M[11] = -1.0;
+    M[14] = (F + N) / (N - F) * -d + 2.0 * F * N / (N - F);
+    M[15] =  d;
+}
+
+// Return the value of the given half float, taking NaN as infinity.
+
+static double unhalf(uint16 h)
+{
+    const int s = (h >> 15);
+    const int e = (h >> 10) & 0x1F;
+    const int m = (h      ) & 0x3FF;
+
+    double f;
+
+    if      (e ==  0) f = ldexp(double(m), -24);
+    else if (e == 31) f = HUGE_VAL;
+    else              f = ldexp(double(m + 1024), e - 25);
+
+    return s ? -f : f;
+}
+
+//------------------------------------------------------------------------------
+
+// Compare the batch forms of scm_vector and scm_locate, which use polynomial
+// approximations of tan and atan, with the scalar forms, which use the library
+// trig functions, at random points of every face, including the face edges.
+
+static bool check_trig()
+{
+    const int m = 1 << 20;
+
+    std::vector<long long> A(m), B(m);
+    std::vector<double>    Y(m), X(m), U(m), W(m);
+    std::vector<double>    V(3 * m);
+
+    srand(1);
+
+    for (int i = 0; i < m; ++i)
+    {
+        A[i] = i % 6;
+        Y[i] = (i % 7 == 0) ? double(i % 2) : double(rand()) / RAND_MAX;
+        X[i] = (i % 5 == 0) ? double(i % 3 == 0) : double(rand()) / RAND_MAX;
+    }
+
+    // Compare the vectors of the batch form with those of the scalar form.
+
+    double ev = 0;
+
+    scm_vector(&A.front(), &Y.front(), &X.front(), &V.front(), m);
+
+    for (int i = 0; i < m; ++i)
+    {
+        double v[3];
+
+        scm_vector(A[i], Y[i], X[i], v);
+
+        for (int j = 0; j < 3; ++j)
+            ev = std::max(ev, fabs(v[j] - V[3 * i + j]));
+    }
+
+    // Locate random vectors, not lying between faces, and compare them.
+
+    for (int i = 0; i < m; ++i)
+        random_vector(&V[3 * i]);
+
+    double el = 0;
+    int    ef = 0;
+
+    scm_locate(&B.front(), &U.front(), &W.front(), &V.front(), m);
+
+    for (int i = 0; i < m; ++i)
+    {
+        long long a;
+        double    y;
+        double    x;
+
+        scm_locate(&a, &y, &x, &V[3 * i]);
+
+        if (a != B[i])
+            ef++;
+        else
+            el = std::max(el, std::max(fabs(y - U[i]), fabs(x - W[i])));
+    }
+
+    char mesg[256];
+
+    sprintf(mesg, "vector error %g, locate error %g, %d faces differ",
+            ev, el, ef);
+
+    return report("trig", ev < 1e-14 && el < 1e-14 && ef == 0, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// Convert values to half float, singly and in a batch. A batch may take a
+// vector path for all but its last few values, where a single value always
+// takes the scalar path, so both must give the same result. Representable
+// values must convert exactly, values beyond the range must give infinity,
+// and others must round to within half of the unit in the last place.
+
+static bool check_half()
+{
+    static const float  F[] = { 0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, 65519.0f,
+                                65520.0f, -1e6f, 5.9604645e-8f, 1e-9f };
+    static const uint16 H[] = { 0x0000, 0x3C00, 0xC000, 0x3800, 0x7BFF,
+                                0x7BFF, 0x7C00, 0xFC00, 0x0001, 0x0000 };
+
+    const int k = int(sizeof (F) / sizeof (float));
+    const int m = 1 << 16;
+
+    std::vector<float>  f(m);
+    std::vector<uint16> h(m);
+
+    srand(1);
+
+    for (int i = 0; i < m; ++i)
+        if (i < k)
+            f[i] = F[i];
+        else
+            f[i] = float(ldexp(1.0 + double(rand()) / RAND_MAX,
+                               rand() % 29 - 14) * (rand() % 2 ? 1 : -1));
+
+    scm_half_copy(size_t(m), &f.front(), &h.front());
+
+    int    ex = 0;
+    int    eb = 0;
+    double er = 0;
+
+    for (int i = 0; i < m; ++i)
+    {
+        uint16 g;
+
+        scm_half_copy(1, &f[i], &g);
+
+        if (g != h[i])
+            eb++;
+        if (i < k)
+            ex += (g != H[i]);
+        else
+            er = std::max(er, fabs(unhalf(g) - f[i]) / fabs(f[i]));
+    }
+
+    char mesg[256];
+
+    sprintf(mesg, "%d inexact, %d batch differ, relative error %g",
+            ex, eb, er);
+
+    return report("half", ex == 0 && eb == 0 && er <= ldexp(1.0, -11), mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// Encode and decode a smooth page of one, two, and three channels, giving BC4,
+// BC5, and BC1 blocks. The round trip must reproduce the page within the error
+// expected of each. The page size, as with a page and its gutter, is not a
+// multiple of the block size.
+
+static bool check_bcn()
+{
+    static const double R[] = { 0, 1.0, 1.0, 3.0 };
+    static const int    E[] = { 0,   2,   3,  12 };
+
+    const int w = 4 * n + 2;
+
+    bool ok = true;
+    char mesg[256];
+    char *s = mesg;
+
+    for (int c = 1; c <= 3; ++c)
+    {
+        const size_t m = size_t(w) * size_t(w) * size_t(c);
+
+        std::vector<uint8> p(m);
+        std::vector<uint8> q(m);
+        std::vector<uint8> b(scm_bcn_size(w, w, c));
+
+        for (int y = 0; y < w; ++y)
+            for (int x = 0; x < w; ++x)
+                for (int d = 0; d < c; ++d)
+                    p[(size_t(y) * w + x) * c + d] =
+                        uint8(127.5 + 100.0 * sin(0.05 * x * (d + 1))
+                                            * cos(0.03 * y));
+
+        scm_bcn_encode(w, w, c, &p.front(), &b.front());
+        scm_bcn_decode(w, w, c, &b.front(), &q.front());
+
+        double r = 0;
+        int    e = 0;
+
+        for (size_t i = 0; i < m; ++i)
+        {
+            const int d = int(p[i]) - int(q[i]);
+
+            r += double(d) * double(d);
+            e  = std::max(e, abs(d));
+        }
+        r = sqrt(r / m);
+
+        s += sprintf(s, "%d channels RMS error %.2f max %d. ", c, r, e);
+
+        ok &= (r <= R[c] && e <= E[c]);
+    }
+    return report("bcn", ok, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// Fill a page set with the pages of the first three levels, pinning the first
+// level and two pages of the second, and eject pages until no more may be. No
+// pinned page may be ejected while they number within the limit. With a lesser
+// limit, pinned pages must become eligible until they number within it. The
+// running count of pinned pages must match a count made anew throughout.
+
+static int pinned(const scm_set& s)
+{
+    int c = 0;
+
+    for (long long i = 0; i < 126; ++i)
+        if (s.find(scm_page(0, i)).is_valid() && s.is_pinned(scm_page(0, i)))
+            c++;
+
+    return c;
+}
+
+static bool check_pin()
+{
+    scm_set s;
+
+    std::vector<long long> v;
+
+    v.push_back(6);
+    v.push_back(7);
+
+    s.set_pin_level(1);
+    s.set_pin_limit(8);
+
+    for (long long i = 0; i < 126; ++i)
+        s.insert(scm_page(0, i, int(i)), int(i));
+
+    int e  = (s.pinned() != 6) + (pinned(s) != 6);
+
+    s.set_pin_pages(v);
+
+    e += (s.pinned() != 8) + (pinned(s) != 8);
+
+    // Eject all unpinned pages, least-recently used first.
+
+    int n0 = 0;
+    int n1 = 0;
+
+    for (scm_page p; !s.empty() && (p = s.eject(1000, 0)).is_valid(); ++n0)
+        e += s.is_pinned(p) + (s.pinned() != pinned(s));
+
+    // Lower the limit and eject pinned pages until within it.
+
+    s.set_pin_limit(5);
+
+    for (scm_page p; !s.empty() && (p = s.eject(1000, 0)).is_valid(); ++n1)
+        e += !s.is_pinned(p) + (s.pinned() != pinned(s));
+
+    const int k = s.pinned();
+
+    s.remove(scm_page(0, 7));
+
+    e += (s.pinned() != k - 1) + (pinned(s) != k - 1);
+
+    s.clear();
+
+    e += (s.pinned() != 0) + !s.empty();
+
+    char mesg[256];
+
+    sprintf(mesg, "%d ejected, then %d pinned, %d remain, %d errors",
+            n0, n1, k, e);
+
+    return report("pin", n0 == 118 && n1 == 3 && k == 5 && e == 0, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// Intersect rays with a height map in which one root page has only two of its
+// four children. Radial rays must hit the ground at the sampled height, in the
+// quadrants lacking children as well as those having them. The root page with
+// children has a value distinct from the others, so that rays striking it in
+// a quadrant lacking a child may be counted.
+
+static bool check_ray(scm_system *sys)
+{
+    const char *name = "scmtest-ray.tif";
+
+    std::vector<long long> i;
+    std::vector<uint8>     k;
+
+    for (long long a = 0; a < 6; ++a)
+    {
+        i.push_back(a);
+        k.push_back(a ? 64 : 128);
+    }
+    i.push_back(scm_page_child(0, 0)); k.push_back(255);
+    i.push_back(scm_page_child(0, 1)); k.push_back(255);
+
+    if (!synth(name, i, k))
+        return report("ray", false, "cannot write synthetic SCM");
+
+    const int s = sys->add_scene(0);
+    scm_scene *S = sys->get_scene(s);
+    scm_image *I = S->get_image(S->add_image(0));
+
+    I->set_name("height");
+    I->set_normal_min(1.0f);
+    I->set_normal_max(1.1f);
+    I->set_scm(name);
+
+    const double r0 = 1.0 + 0.1 * 128 / 255;
+    const double r1 = 1.1;
+
+    int miss = 0;
+    int err  = 0;
+    int n0   = 0;
+    int n1   = 0;
+
+    srand(1);
+
+    for (int j = 0; j < 10000; ++j)
+    {
+        double u[3];
+        double p[3];
+        double d[3];
+        double t;
+
+        random_vector(u);
+
+        p[0] =  2 * u[0];
+        p[1] =  2 * u[1];
+        p[2] =  2 * u[2];
+        d[0] = -u[0];
+        d[1] = -u[1];
+        d[2] = -u[2];
+
+        const double r = sys->get_current_ground(u);
+
+        if (!sys->get_ray_ground(p, d, t))
+            miss++;
+        else if (fabs((2 - t) - r) > 1e-4)
+            err++;
+
+        if (fabs(r - r0) < 1e-3) n0++;
+        if (fabs(r - r1) < 1e-3) n1++;
+    }
+
+    sys->del_scene(s);
+    remove(name);
+
+    char mesg[256];
+
+    sprintf(mesg, "%d of 10000 rays missed, %d erred", miss, err);
+
+    return report("ray", miss == 0 && err == 0 && n0 > 0 && n1 > 0, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// View a height map of three levels with a range of viewport sizes, hovering
+// larger and smaller by a small fraction at each. The view does not move, so
+// that pages do not enter or leave the view, and only subdivision varies. The
+// steps of size are smaller than the hover, so that every threshold is hovered.
+// Return the churn once the hover has settled, and give the total churn and
+// the churn of repeating a view.
+
+static int hover(scm_sphere *P, scm_scene *S, double split, double merge,
+                 int& total, int& repeat)
+{
+    double M[16];
+    int    c = 0;
+    int    w = 0;
+
+    look(M, 3.0);
+
+    P->set_split(split);
+    P->set_merge(merge);
+
+    total  = 0;
+    repeat = 0;
+
+    for (int j = 0; j < 128; ++j)
+    {
+        const double d = 64.0 * pow(2.0, j / 16.0);
+
+        for (int k = 0; k < 5; ++k)
+        {
+            w = int(d * ((k % 2) ? 0.97 : 1.03));
+
+            P->prep(S, M, w, w, 0, false);
+
+            total += P->get_churn();
+
+            if (k > 1)
+                c += P->get_churn();
+        }
+
+        P->prep(S, M, w, w, 0, false);
+
+        repeat += P->get_churn();
+    }
+    return c;
+}
+
+// Hovering must churn the subdivision without hysteresis, and must not churn
+// it with hysteresis. The range of sizes must subdivide. Repeating a view must
+// not churn the subdivision in either case.
+
+static bool check_churn(scm_system *sys)
+{
+    const char *name = "scmtest-churn.tif";
+
+    std::vector<long long> i;
+    std::vector<uint8>     k;
+
+    for (long long a = 0; a < 126; ++a)
+    {
+        i.push_back(a);
+        k.push_back(128);
+    }
+
+    if (!synth(name, i, k))
+        return report("churn", false, "cannot write synthetic SCM");
+
+    const int s = sys->add_scene(0);
+    scm_scene  *S = sys->get_scene(s);
+    scm_image  *I = S->get_image(S->add_image(0));
+    scm_sphere *P = sys->get_sphere();
+
+    I->set_name("height");
+    I->set_normal_min(1.0f);
+    I->set_normal_max(1.1f);
+    I->set_scm(name);
+
+    const double split = P->get_split();
+    const double merge = P->get_merge();
+
+    int t0, r0;
+    int t1, r1;
+
+    const int c0 = hover(P, S, 1.00, 1.0, t0, r0);
+    const int c1 = hover(P, S, 1.25, 0.8, t1, r1);
+
+    P->set_split(split);
+    P->set_merge(merge);
+
+    sys->del_scene(s);
+    remove(name);
+
+    char mesg[256];
+
+    sprintf(mesg, "hover churn %d without hysteresis, %d with, "
+                  "total %d and %d, repeat %d and %d", c0, c1, t0, t1, r0, r1);
+
+    return report("churn", c0 > 0 && c1 == 0 && t1 > 0
+                                  && r0 == 0 && r1 == 0, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// Request a constant page and read back the atlas line that it is given. Every
+// texel of the line must have the constant value at every mipmap level.
+
+static bool check_const(scm_system *sys)
+{
+    const char *name = "scmtest-const.tif";
+
+    std::vector<long long> i;
+    std::vector<uint8>     k;
+
+    for (long long a = 0; a < 6; ++a)
+    {
+        i.push_back(a);
+        k.push_back(uint8(100 + a));
+    }
+
+    if (!synth(name, i, k))
+        return report("const", false, "cannot write synthetic SCM");
+
+    const int  f = sys->acquire_scm(name);
+    scm_cache *C = sys->get_cache(f);
+
+    int l = 0;
+    int u = 0;
+    int e = 0;
+
+    if (C)
+    {
+        l = C->get_page(f, 3, 1, u, 1.0f, 0);
+        C->update(1, true);
+    }
+
+    if (C && l > 0)
+        for (int j = 0; j <= C->get_mip_levels(); ++j)
+            e += differ(C, l, j, k[3]);
+
+    const int L = C ? C->get_mip_levels() : 0;
+
+    sys->release_scm(name);
+    remove(name);
+
+    char mesg[256];
+
+    sprintf(mesg, "line %d, %d mipmap levels, %d texels differ", l, L, e);
+
+    return report("const", l > 0 && L > 0 && e == 0, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// Patch a page of a loaded SCM in place, replacing one page and adding a child
+// of it. The catalog must give the offsets of both and extrema recomputed up
+// the ancestor chain. Reloading the SCM must drop the replaced page from the
+// cache, and a new request must load the patched content. Constant pages are
+// loaded as any other, so that the page is read from the file.
+
+static bool check_patch(scm_system *sys)
+{
+    const char *name = "scmtest-patch.tif";
+
+    const long long c0  = scm_page_child(0,  0);
+    const long long c00 = scm_page_child(c0, 0);
+
+    std::vector<long long> i;
+    std::vector<uint8>     k;
+
+    for (long long a = 0; a < 6; ++a)
+    {
+        i.push_back(a);
+        k.push_back(64);
+    }
+    for (long long j = 0; j < 4; ++j)
+    {
+        i.push_back(scm_page_child(0, j));
+        k.push_back(100);
+    }
+
+    if (!synth(name, i, k))
+        return report("patch", false, "cannot write synthetic SCM");
+
+    const int L = scm_cache::const_lines;
+
+    scm_cache::const_lines = 0;
+
+    const int  f = sys->acquire_scm(name);
+    scm_cache *C = sys->get_cache(f);
+
+    const int l0 = C ? load(C, f, c0) : 0;
+
+    // Append the replacement page and the new child, and patch the catalog.
+
+    std::vector<uint64> pi;
+    std::vector<uint64> po(2, 0);
+    std::vector<uint8>  p(size_t(n + 2) * size_t(n + 2));
+
+    pi.push_back(uint64(c0));
+    pi.push_back(uint64(c00));
+
+    bool ok = false;
+
+    if (TIFF *T = TIFFOpen(name, "a"))
+    {
+        std::fill(p.begin(), p.end(), 200);
+        ok = scm_write_page(T, n + 2, n + 2, 1, 8, &p.front(), po[0]);
+
+        std::fill(p.begin(), p.end(), 10);
+        ok = ok && scm_write_page(T, n + 2, n + 2, 1, 8, &p.front(), po[1]);
+
+        TIFFClose(T);
+    }
+    if (ok)
+    {
+        ok = false;
+
+        if (TIFF *T = TIFFOpen(name, "r+"))
+        {
+            ok = scm_patch_catalog(T, pi, po);
+            TIFFClose(T);
+        }
+    }
+
+    // Check the offsets of the patched pages and the extrema of every page.
+
+    std::vector<uint64> x;
+    std::vector<uint64> o;
+    std::vector<uint8>  a;
+    std::vector<uint8>  z;
+
+    int e = 0;
+
+    if (ok)
+    {
+        ok = false;
+
+        if (TIFF *T = TIFFOpen(name, "r"))
+        {
+            ok = scm_read_catalog(T, x, o, a, z);
+            TIFFClose(T);
+        }
+    }
+    if (ok)
+    {
+        for (size_t j = 0; j < x.size(); ++j)
+        {
+            uint8 lo = 64;
+            uint8 hi = 64;
+
+            if      (x[j] == 0)             { lo =  10; hi = 200; }
+            else if (x[j] == uint64(c0))    { lo =  10; hi = 200;
+                                              e += (o[j] != po[0]); }
+            else if (x[j] == uint64(c00))   { lo =  10; hi =  10;
+                                              e += (o[j] != po[1]); }
+            else if (x[j] > 5)              { lo = 100; hi = 100; }
+
+            e += (a[j] != lo || z[j] != hi);
+        }
+        e += (x.size() != i.size() + 1);
+    }
+
+    // Reload the SCM and check that the page is dropped and loads anew.
+
+    int u;
+
+    const bool r  = ok && sys->reload_scm(name);
+    const int  l1 = C ? C->find_page(f, c0, frame, u) : 0;
+    const int  l2 = (r && C) ? load(C, f, c0) : 0;
+    const int  d  = l2 ? differ(C, l2, 0, 200) : -1;
+
+    sys->release_scm(name);
+    remove(name);
+
+    scm_cache::const_lines = L;
+
+    char mesg[256];
+
+    sprintf(mesg, "%d catalog errors, line %d before reload, %d after, "
+                  "%d reloaded, %d texels differ", e, l0, l1, l2, d);
+
+    return report("patch", ok && e == 0 && r && l0 > 0 && l1 == 0
+                                              && l2 > 0 && d == 0, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+// Load identical pages with deduplication enabled. They must share one atlas
+// line, which must outlive the ejection of either page alone and be released
+// for reuse when both are gone. Constant pages are loaded as any other, so
+// that they are hashed.
+
+static bool check_dedup(scm_system *sys)
+{
+    const char *name = "scmtest-dedup.tif";
+
+    const uint8 v[6] = { 50, 50, 60, 70, 80, 90 };
+
+    std::vector<long long> i;
+    std::vector<uint8>     k;
+
+    for (long long a = 0; a < 6; ++a)
+    {
+        i.push_back(a);
+        k.push_back(v[a]);
+    }
+
+    if (!synth(name, i, k))
+        return report("dedup", false, "cannot write synthetic SCM");
+
+    const int L = scm_cache::const_lines;
+    const int D = scm_cache::cache_dedup;
+
+    scm_cache::const_lines = 0;
+    scm_cache::cache_dedup = 1;
+
+    const int  f = sys->acquire_scm(name);
+    scm_cache *C = sys->get_cache(f);
+
+    int l0 = 0, l1 = 0, l2 = 0, l3 = 0, l4 = 0, h = 0, e = 0, u;
+
+    if (C)
+    {
+        // Pages 0 and 1 share a line. Page 2 does not.
+
+        l0 = load(C, f, 0);
+        l1 = load(C, f, 1);
+        l2 = load(C, f, 2);
+        h  = C->get_dedup_hits();
+
+        // Dropping page 0 leaves the line to page 1.
+
+        C->drop(f, 0);
+
+        e += (C->find_page(f, 1, frame, u) != l0);
+        e += (l0 ? differ(C, l0, 0, 50) : 1);
+
+        l3 = load(C, f, 3);
+
+        // Dropping page 1 releases the line, which page 4 then takes.
+
+        C->drop(f, 1);
+
+        l4 = load(C, f, 4);
+        e += (l4 ? differ(C, l4, 0, 80) : 1);
+    }
+
+    sys->release_scm(name);
+    remove(name);
+
+    scm_cache::const_lines = L;
+    scm_cache::cache_dedup = D;
+
+    char mesg[256];
+
+    sprintf(mesg, "lines %d %d %d %d %d, %d hits, %d errors",
+            l0, l1, l2, l3, l4, h, e);
+
+    return report("dedup", l0 > 0 && l1 == l0 && l2 > 0 && l2 != l0
+                                  && l3 > 0 && l3 != l0 && l4 == l0
+                                  && h == 1 && e == 0, mesg);
+}
+
+//------------------------------------------------------------------------------
+
+int main(int, char **argv)
+{
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", argv[0], SDL_GetError());
+        return EXIT_FAILURE;
+    }
+
+    SDL_Window   *window  = SDL_CreateWindow(argv[0], 0, 0, 64, 64,
+                                             SDL_WINDOW_OPENGL |
+                                             SDL_WINDOW_HIDDEN);
+    SDL_GLContext context = window ? SDL_GL_CreateContext(window) : 0;
+
+    if (context == 0 || glewInit() != GLEW_OK)
+    {
+        fprintf(stderr, "%s: cannot create OpenGL context\n", argv[0]);
+        SDL_Quit();
+        return EXIT_FAILURE;
+    }
+
+    // Constant pages and mipmaps are enabled for the cache check.
+
+    scm_cache::const_lines   = 16;
+    scm_cache::cache_mipmaps =  4;
+
+    bool ok = true;
+    {
+        scm_system sys(64, 64, 16, 256);
+
+        ok &= check_trig();
+        ok &= check_half();
+        ok &= check_bcn();
+        ok &= check_pin();
+        ok &= check_ray(&sys);
+        ok &= check_churn(&sys);
+        ok &= check_const(&sys);
+        ok &= check_patch(&sys);
+        ok &= check_dedup(&sys);
+    }
+
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,387 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <cmath>
+#include <algorithm>
+
+#include "scm-bcn.hpp"
+
+//------------------------------------------------------------------------------
+
+// Copy the 4x4 block at pixel x, y of the w-by-h image p of c channels to v,
+// replicating the last row and column where the block overhangs the image.
+
+static void gather(int w, int h, int c, const uint8 *p, int x, int y, uint8 *v)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint8 *r = p + size_t(std::min(y + i, h - 1)) * w * c;
+
+        for (int j = 0; j < 4; ++j)
+        {
+            const uint8 *s = r + std::min(x + j, w - 1) * c;
+
+            for (int d = 0; d < c; ++d)
+                *v++ = s[d];
+        }
+    }
+}
+
+// Copy the 4x4 block v of c channels to pixel x, y of the w-by-h image p,
+// omitting any pixels that overhang the image.
+
+static void scatter(int w, int h, int c, uint8 *p, int x, int y, const uint8 *v)
+{
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j, v += c)
+            if (y + i < h && x + j < w)
+                std::copy(v, v + c, p + (size_t(y + i) * w + x + j) * c);
+}
+
+//------------------------------------------------------------------------------
+
+// Encode 16 samples v with stride s as a BC4 block. The extrema of the block
+// become the endpoints, in the order selecting eight interpolated values.
+
+static void encode_bc4(const uint8 *v, int s, uint8 *o)
+{
+    int a = 255;
+    int z =   0;
+
+    for (int k = 0; k < 16; ++k)
+    {
+        a = std::min(a, int(v[k * s]));
+        z = std::max(z, int(v[k * s]));
+    }
+
+    uint64 bits = 0;
+
+    if (z > a)
+        for (int k = 0; k < 16; ++k)
+        {
+            // Find the nearest of the eight steps from z to a, and its index.
+
+            const int p = ((z - v[k * s]) * 14 + (z - a)) / (2 * (z - a));
+            const int i = (p == 0) ? 0 : (p == 7) ? 1 : p + 1;
+
+            bits |= uint64(i) << (3 * k);
+        }
+
+    o[0] = uint8(z);
+    o[1] = uint8(a);
+
+    for (int k = 0; k < 6; ++k)
+        o[k + 2] = uint8(bits >> (8 * k));
+}
+
+// Decode BC4 block o to 16 samples v with stride s.
+
+static void decode_bc4(const uint8 *o, uint8 *v, int s)
+{
+    const int r0 = o[0];
+    const int r1 = o[1];
+
+    int pal[8] = { r0, r1, 0, 0, 0, 0, 0, 255 };
+
+    if (r0 > r1)
+        for (int k = 1; k < 7; ++k)
+            pal[k + 1] = ((7 - k) * r0 + k * r1 + 3) / 7;
+    else
+        for (int k = 1; k < 5; ++k)
+            pal[k + 1] = ((5 - k) * r0 + k * r1 + 2) / 5;
+
+    uint64 bits = 0;
+
+    for (int k = 0; k < 6; ++k)
+        bits |= uint64(o[k + 2]) << (8 * k);
+
+    for (int k = 0; k < 16; ++k)
+        v[k * s] = uint8(pal[(bits >> (3 * k)) & 7]);
+}
+
+//------------------------------------------------------------------------------
+
+// Quantize an RGB color to 5:6:5.
+
+static int pack565(const double *c)
+{
+    const int r = int(std::max(0.0, std::min(31.0, c[0] * 31.0 / 255.0 + 0.5)));
+    const int g = int(std::max(0.0, std::min(63.0, c[1] * 63.0 / 255.0 + 0.5)));
+    const int b = int(std::max(0.0, std::min(31.0, c[2] * 31.0 / 255.0 + 0.5)));
+
+    return (r << 11) | (g << 5) | b;
+}
+
+// Expand a 5:6:5 color to 8-bit RGB.
+
+static void unpack565(int q, int *c)
+{
+    const int r = (q >> 11) & 31;
+    const int g = (q >>  5) & 63;
+    const int b = (q      ) & 31;
+
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+// Compute the BC1 palette of endpoints q0 and q1.
+
+static void palette_bc1(int q0, int q1, int pal[4][3])
+{
+    unpack565(q0, pal[0]);
+    unpack565(q1, pal[1]);
+
+    for (int d = 0; d < 3; ++d)
+        if (q0 > q1)
+        {
+            pal[2][d] = (2 * pal[0][d] + pal[1][d] + 1) / 3;
+            pal[3][d] = (pal[0][d] + 2 * pal[1][d] + 1) / 3;
+        }
+        else
+        {
+            pal[2][d] = (pal[0][d] + pal[1][d]) / 2;
+            pal[3][d] = 0;
+        }
+}
+
+// Encode 16 RGB pixels v with stride s as a BC1 block. The endpoints are the
+// extremes of the block's colors along their principal axis.
+
+static void encode_bc1(const uint8 *v, int s, uint8 *o)
+{
+    // Find the mean and covariance of the colors.
+
+    double m[3] = { 0, 0, 0 };
+    double C[3][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+
+    for (int k = 0; k < 16; ++k)
+        for (int i = 0; i < 3; ++i)
+            m[i] += v[k * s + i] / 16.0;
+
+    for (int k = 0; k < 16; ++k)
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                C[i][j] += (v[k * s + i] - m[i]) * (v[k * s + j] - m[j]);
+
+    // Find the principal axis by power iteration, beginning with the row of
+    // greatest variance.
+
+    int l = 0;
+
+    if (C[1][1] > C[l][l]) l = 1;
+    if (C[2][2] > C[l][l]) l = 2;
+
+    double a[3] = { C[l][0], C[l][1], C[l][2] };
+
+    for (int n = 0; n < 8; ++n)
+    {
+        double b[3];
+        double d = 0;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            b[i] = C[i][0] * a[0] + C[i][1] * a[1] + C[i][2] * a[2];
+            d   += b[i] * b[i];
+        }
+        if (d > 0)
+        {
+            d = sqrt(d);
+            a[0] = b[0] / d;
+            a[1] = b[1] / d;
+            a[2] = b[2] / d;
+        }
+        else break;
+    }
+
+    // Project the colors onto the axis and take the extremes as endpoints.
+
+    double t0 = 0;
+    double t1 = 0;
+
+    for (int k = 0; k < 16; ++k)
+    {
+        const double t = (v[k * s + 0] - m[0]) * a[0]
+                       + (v[k * s + 1] - m[1]) * a[1]
+                       + (v[k * s + 2] - m[2]) * a[2];
+        t0 = std::max(t0, t);
+        t1 = std::min(t1, t);
+    }
+
+    double e0[3];
+    double e1[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        e0[i] = m[i] + a[i] * t0;
+        e1[i] = m[i] + a[i] * t1;
+    }
+
+    int q0 = pack565(e0);
+    int q1 = pack565(e1);
+
+    // Order the endpoints to select the four-color palette, and map each
+    // pixel to its nearest palette entry. Equal endpoints select entry zero.
+
+    if (q0 < q1)
+        std::swap(q0, q1);
+
+    uint32 bits = 0;
+
+    if (q0 > q1)
+    {
+        int pal[4][3];
+
+        palette_bc1(q0, q1, pal);
+
+        for (int k = 0; k < 16; ++k)
+        {
+            int e = 0;
+            int E = 0x7FFFFFFF;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                const int dr = v[k * s + 0] - pal[i][0];
+                const int dg = v[k * s + 1] - pal[i][1];
+                const int db = v[k * s + 2] - pal[i][2];
+                const int dd = dr * dr + dg * dg + db * db;
+
+                if (dd < E)
+                {
+                    E = dd;
+                    e = i;
+                }
+            }
+            bits |= uint32(e) << (2 * k);
+        }
+    }
+
+    o[0] = uint8(q0);
+    o[1] = uint8(q0 >> 8);
+    o[2] = uint8(q1);
+    o[3] = uint8(q1 >> 8);
+    o[4] = uint8(bits);
+    o[5] = uint8(bits >>  8);
+    o[6] = uint8(bits >> 16);
+    o[7] = uint8(bits >> 24);
+}
+
+// Decode BC1 block o to 16 RGB pixels v with stride s.
+
+static void decode_bc1(const uint8 *o, uint8 *v, int s)
+{
+    const int    q0   = o[0] | (o[1] << 8);
+    const int    q1   = o[2] | (o[3] << 8);
+    const uint32 bits = uint32(o[4])       | (uint32(o[5]) <<  8)
+                      | (uint32(o[6]) << 16) | (uint32(o[7]) << 24);
+    int pal[4][3];
+
+    palette_bc1(q0, q1, pal);
+
+    for (int k = 0; k < 16; ++k)
+    {
+        const int e = (bits >> (2 * k)) & 3;
+
+        v[k * s + 0] = uint8(pal[e][0]);
+        v[k * s + 1] = uint8(pal[e][1]);
+        v[k * s + 2] = uint8(pal[e][2]);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+/// Return the OpenGL compressed internal format for pages of c channels of b
+/// bits, or zero if such pages are not compressed.
+///
+/// @param c Channels per pixel
+/// @param b Bits per channel
+
+GLenum scm_bcn_form(uint16 c, uint16 b)
+{
+    if (b == 8)
+        switch (c)
+        {
+        case  1: return GL_COMPRESSED_RED_RGTC1;
+        case  2: return GL_COMPRESSED_RG_RGTC2;
+        case  3: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        }
+    return 0;
+}
+
+/// Return the size in bytes of a compressed w-by-h image of c channels.
+///
+/// @param w Image width
+/// @param h Image height
+/// @param c Channels per pixel
+
+size_t scm_bcn_size(int w, int h, int c)
+{
+    return size_t((w + 3) / 4) * size_t((h + 3) / 4) * (c == 2 ? 16 : 8);
+}
+
+/// Compress a w-by-h image of c 8-bit channels. The destination must have the
+/// size given by scm_bcn_size. Blocks are written in row-major order.
+///
+/// @param w Image width
+/// @param h Image height
+/// @param c Channels per pixel
+/// @param p Source pixel buffer
+/// @param o Destination block buffer
+
+void scm_bcn_encode(int w, int h, int c, const uint8 *p, uint8 *o)
+{
+    uint8 v[64];
+
+    for (int y = 0; y < h; y += 4)
+        for (int x = 0; x < w; x += 4)
+        {
+            gather(w, h, c, p, x, y, v);
+
+            switch (c)
+            {
+            case 1: encode_bc4(v,     1, o);      o +=  8; break;
+            case 2: encode_bc4(v,     2, o);
+                    encode_bc4(v + 1, 2, o + 8);  o += 16; break;
+            case 3: encode_bc1(v,     3, o);      o +=  8; break;
+            }
+        }
+}
+
+/// Decompress a w-by-h image of c 8-bit channels compressed by scm_bcn_encode.
+/// This gives the image as the GPU will see it, up to interpolation rounding.
+///
+/// @param w Image width
+/// @param h Image height
+/// @param c Channels per pixel
+/// @param o Source block buffer
+/// @param p Destination pixel buffer
+
+void scm_bcn_decode(int w, int h, int c, const uint8 *o, uint8 *p)
+{
+    uint8 v[64];
+
+    for (int y = 0; y < h; y += 4)
+        for (int x = 0; x < w; x += 4)
+        {
+            switch (c)
+            {
+            case 1: decode_bc4(o,     v,     1);  o +=  8; break;
+            case 2: decode_bc4(o,     v,     2);
+                    decode_bc4(o + 8, v + 1, 2);  o += 16; break;
+            case 3: decode_bc1(o,     v,     3);  o +=  8; break;
+            }
+
+            scatter(w, h, c, p, x, y, v);
+        }
+}
+
+//------------------------------------------------------------------------------
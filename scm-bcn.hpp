@@ -0,0 +1,37 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef SCM_BCN_HPP
+#define SCM_BCN_HPP
+
+#include <cstddef>
+
+#include <GL/glew.h>
+#include <tiffio.h>
+
+//------------------------------------------------------------------------------
+/// @file
+///
+/// Block compression of page data for upload in GPU-native formats. One- and
+/// two-channel 8-bit pages are compressed as BC4 and BC5 (RGTC1 and RGTC2) and
+/// three-channel 8-bit pages as BC1 (DXT1). Each 4x4 block of pixels becomes
+/// 8 bytes per BC1 or BC4 block and 16 bytes per BC5 block. Images whose size
+/// is not a multiple of 4 are padded by replicating the last row and column.
+
+GLenum scm_bcn_form  (uint16, uint16);
+size_t scm_bcn_size  (int, int, int);
+void   scm_bcn_encode(int, int, int, const uint8 *, uint8 *);
+void   scm_bcn_decode(int, int, int, const uint8 *, uint8 *);
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -13,11 +13,14 @@
 #include <GL/glew.h>
 
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 #include <limits>
+#include <algorithm>
 
 #include "scm-cache.hpp"
 #include "scm-system.hpp"
+#include "scm-bcn.hpp"
 #include "scm-index.hpp"
 #include "scm-log.hpp"
 
@@ -52,6 +55,66 @@ int scm_cache::load_queue_size =  8;
 
 int scm_cache::loads_per_cycle =  2;
 
+/// The maximum number of speculative prefetch requests that may be issued to
+/// the loader threads each frame. Set 0 to disable prefetching.
+
+int scm_cache::fetches_per_cycle = 4;
+
+/// Set nonzero to block compress pages on the loader threads: one-channel
+/// 8-bit pages as BC4, two-channel as BC5, and three-channel as BC1. This
+/// quarters or halves the upload bandwidth and atlas memory of such pages,
+/// with some loss of quality, which scmbcn measures. Other formats, and any
+/// not supported by the OpenGL implementation, are uploaded as-is.
+
+int scm_cache::cache_compress = 0;
+
+/// Set nonzero to store 32-bit float pages in the atlas as 16-bit half floats,
+/// converted on the loader threads. This halves the upload bandwidth and atlas
+/// memory of such pages. Half precision suffices for height data normalized by
+/// k0 and k1, but not for raw heights of large magnitude.
+
+int scm_cache::cache_half = 0;
+
+/// The maximum number of atlas lines given to constant pages. Each distinct
+/// constant value occupies one line. Constant pages of values beyond this
+/// limit are loaded as any other. Set 0 to disable constant page elision.
+
+int scm_cache::const_lines = 16;
+
+/// Set nonzero to hash the content of each loaded page and let identical pages
+/// share one atlas line. This costs a copy and a hash of each page on the
+/// loader threads, and saves the upload and atlas line of each duplicate. It
+/// pays only for data with many identical pages, so it is off by default.
+
+int scm_cache::cache_dedup = 0;
+
+/// The number of mipmap levels beyond the base stored in the atlas. Each page
+/// is reduced by the loader threads and all of its levels are uploaded, at a
+/// cost of up to a third more upload and atlas memory. Minified pages then
+/// filter rather than alias, which allows a coarser scene detail limit. The
+/// number is reduced to that by which the atlas line divides evenly (and for
+/// compressed pages, into whole blocks). At each level the page gutter is
+/// narrower, so a coarse level may bleed up to half a texel across the page
+/// edge. Set 0 to disable mipmapping.
+
+int scm_cache::cache_mipmaps = 0;
+
+/// The strip stride of reduced proxies. If greater than one, a page requested
+/// on demand from an SCM TIFF is first loaded by decoding only every so many of
+/// its strips, interpolating the rows between. The proxy is shown at once, at
+/// a fraction of the decode cost, and is replaced by the full page when that
+/// arrives, at the cost of a second upload. Pages of too few strips, and pages
+/// of SCM packs, are loaded in full. Set 0 to disable proxies.
+
+int scm_cache::proxy_stride = 0;
+
+/// The largest share of the atlas lines, in percent, that pinned pages may
+/// hold. While more pages than this are pinned and resident, pinned pages are
+/// ejected as any other, so that an overly large pin set cannot starve the
+/// rest of the cache.
+
+int scm_cache::pin_share = 50;
+
 //------------------------------------------------------------------------------
 
 /// Create a new page cache with a queue for making page requests
@@ -74,8 +137,40 @@ scm_cache::scm_cache(scm_system *sys, int n, int c, int b) :
     l(1),
     n(n),
     c(c),
-    b(b)
+    b(b),
+    e(b),
+    m(n + 2),
+    z(0),
+    levels(0),
+    fetches(0),
+    fetch_count(0),
+    fetch_hits(0),
+    fetch_waste(0),
+    const_count(0),
+    dedup_count(0),
+    dedup_hits(0),
+    proxy_count(0),
+    refine_count(0)
 {
+    // Order the atlas lines along a Hilbert curve. Line 0 remains first.
+
+    long long d = 0;
+
+    while ((1 << d) < s)
+        d++;
+
+    std::vector<std::pair<long long, int> > v;
+
+    for (int k = 0; k < s * s; ++k)
+        v.push_back(std::make_pair(scm_hilbert(d, k / s, k % s), k));
+
+    std::sort(v.begin(), v.end());
+
+    for (int k = 0; k < s * s; ++k)
+        lines.push_back(v[k].second);
+
+    pages.set_pin_limit((s * s - 1) * pin_share / 100);
+
     // Generate pixel buffer objects.
 
     for (int i = 0; i < 2 * need_queue_size; ++i)
@@ -85,32 +180,80 @@ scm_cache::scm_cache(scm_system *sys, int n, int c, int b) :
         pbos.push_back(o);
     }
 
+    // Select a compressed format if requested and supported. Luminance pages
+    // compress to red and red-green formats, swizzled back to luminance.
+
+    if (cache_compress && GLEW_EXT_texture_compression_s3tc
+                       && GLEW_ARB_texture_compression_rgtc
+                       && GLEW_ARB_texture_swizzle)
+    {
+        if ((z = scm_bcn_form(c, b)))
+            m = (n + 5) & ~3;
+    }
+    if (cache_half && b == 32 && GLEW_ARB_half_float_pixel
+                              && GLEW_ARB_texture_float)
+        e = 16;
+
+    // Take as many mipmap levels as requested and as divide the line evenly.
+    // A padded compressed line is not mipmapped.
+
+    if (m == n + 2)
+        while (levels < cache_mipmaps && (m >> levels) % (z ? 8 : 2) == 0)
+            levels++;
+
     // Generate the array texture object.
 
-    GLenum i = scm_internal_form(c, b);
-    GLenum e = scm_external_form(c, b);
-    GLenum y = scm_external_type(c, b);
+    GLenum i = (e != b) ? scm_half_form(c)  : scm_internal_form(c, b);
+    GLenum x =                                scm_external_form(c, b);
+    GLenum y = (e != b) ? GL_HALF_FLOAT_ARB : scm_external_type(c, b);
 
     glGenTextures  (1, &texture);
     glBindTexture  (GL_TEXTURE_2D, texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels ?
+                                   GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels);
 
-//  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-//  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16);
-//  glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-
-    // Initialize it with a buffer of zeros.
+    if (z && c == 1)
+    {
+        GLint w[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, w);
+    }
+    if (z && c == 2)
+    {
+        GLint w[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, w);
+    }
 
-    const int m = s * (n + 2);
+    // Initialize each level with a buffer of zeros, which is black in all
+    // formats.
 
-    if (GLubyte *p = (GLubyte *) calloc(m * m, scm_pixel_size(c, b)))
+    for (int k = 0; k <= levels; ++k)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, i, m, m, 0, e, y, p);
-        free(p);
+        const int M = (s * m) >> k;
+
+        if (z)
+        {
+            const GLsizei S = GLsizei(scm_bcn_size(M, M, c));
+
+            if (GLubyte *p = (GLubyte *) calloc(S, 1))
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, k, z, M, M, 0, S, p);
+                free(p);
+            }
+        }
+        else
+        {
+            if (GLubyte *p = (GLubyte *) calloc(M * M, scm_pixel_size(c, e)))
+            {
+                glTexImage2D(GL_TEXTURE_2D, k, i, M, M, 0, x, y, p);
+                free(p);
+            }
+        }
     }
 
-    scm_log("scm_cache constructor %d %d %d", n, c, b);
+    scm_log("scm_cache constructor %d %d %d %s", n, c, b, z ? "compressed" :
+                                                 (e != b) ? "half" : "");
 }
 
 /// Destroy a page cache and finalize all OpenGL state
@@ -123,6 +266,14 @@ scm_cache::~scm_cache()
 
     update(0, true);
 
+    // Discard any loads held for their groups.
+
+    for (size_t j = 0; j < held.size(); ++j)
+    {
+        held[j].dump_page();
+        pbos.enq(held[j].u);
+    }
+
     // Release the pixel buffer objects.
 
     while (!pbos.empty())
@@ -162,8 +313,10 @@ GLuint scm_cache::get_texture() const
 /// @param i Page index
 /// @param t Current time
 /// @param u Time at which the page was loaded.
+/// @param k Priority of the request, should one be necessary.
+/// @param g Load group of the request, or zero.
 
-int scm_cache::get_page(int f, long long i, int t, int& u)
+int scm_cache::get_page(int f, long long i, int t, int& u, float k, int g)
 {
     if (scm_file *file = sys->get_file(f))
     {
@@ -174,12 +327,32 @@ int scm_cache::get_page(int f, long long i, int t, int& u)
         if (o == 0)
             return 0;
 
+        // If this page is constant, return the line shared by its value.
+
+        if (const_lines)
+        {
+            uint8 v[16];
+
+            if (file->get_page_const(i, v))
+            {
+                int l = get_const(std::string((const char *) v,
+                                              size_t(c) * b / 8), t, u);
+                if (l >= 0)
+                {
+                    const_count++;
+                    return l;
+                }
+            }
+        }
+
         // If this page is waiting, return the filler.
 
         scm_page wait = waits.search(scm_page(f, i), t);
 
         if (wait.is_valid())
         {
+            raise_fetch(file, f, i, k);
+            use_fetch(f, i);
             u    = wait.t;
             return wait.l;
         }
@@ -190,20 +363,55 @@ int scm_cache::get_page(int f, long long i, int t, int& u)
 
         if (page.is_valid())
         {
+            use_fetch(f, i);
+
+            // If it is a proxy, request its full content in the caller's load
+            // group, so that the full pages of all images land together.
+
+            if (!proxies.empty() && proxies.find(page) != proxies.end()
+                                 && refining.find(page) == refining.end()
+                                 && !pbos.empty())
+            {
+                scm_task task(f, i, o, n, c, b, pbos.deq(), this, k);
+
+                task.q = true;
+                task.g = g;
+
+                if (file->add_need(task))
+                {
+                    refining.insert(scm_item(f, i));
+
+                    if (g)
+                        sys->join_group(g);
+                }
+                else
+                {
+                    task.dump_page();
+                    pbos.enq(task.u);
+                }
+            }
+
             u    = page.t;
             return page.l;
         }
 
-        // Otherwise request the page and add it to the waiting set.
+        // Otherwise request the page and add it to the waiting set. A demand
+        // request begins with a proxy if proxies are enabled.
 
         if (!pbos.empty())
         {
-            scm_task task(f, i, o, n, c, b, pbos.deq(), this);
+            scm_task task(f, i, o, n, c, b, pbos.deq(), this, k);
             scm_page page(f, i, 0);
 
+            task.r = (proxy_stride > 1 && file->get_pack() == 0);
+            task.g = g;
+
             if (file->add_need(task))
             {
                 waits.insert(page, t);
+
+                if (g)
+                    sys->join_group(g);
             }
             else
             {
@@ -219,9 +427,224 @@ int scm_cache::get_page(int f, long long i, int t, int& u)
     return 0;
 }
 
+/// Return the cache line of a loaded page without requesting it
+///
+/// This serves a page already touched this frame, so that drawing never issues
+/// a request outside the priority order and load group of the touch. Return 0
+/// if the page is not available.
+///
+/// @param f File index
+/// @param i Page index
+/// @param t Current time
+/// @param u Time at which the page was loaded.
+
+int scm_cache::find_page(int f, long long i, int t, int& u)
+{
+    if (scm_file *file = sys->get_file(f))
+    {
+        // If this page is constant and its line is written, return that line.
+
+        if (const_lines)
+        {
+            uint8 v[16];
+
+            if (file->get_page_const(i, v))
+            {
+                std::map<std::string, scm_page>::iterator j =
+                    consts.find(std::string((const char *) v,
+                                            size_t(c) * b / 8));
+
+                if (j != consts.end() && unmade.find(j->first) == unmade.end())
+                {
+                    u = j->second.t;
+                    return j->second.l;
+                }
+            }
+        }
+
+        // If this page is loaded, return the index.
+
+        scm_page page = pages.search(scm_page(f, i), t);
+
+        if (page.is_valid())
+        {
+            u = page.t;
+            return page.l;
+        }
+    }
+    u = t;
+    return 0;
+}
+
+/// Request a page speculatively, in anticipation of its future use
+///
+/// The request is made only if the page is neither loaded nor waiting, if the
+/// prefetch budget for this cycle is not exhausted, and if more than half of
+/// the pixel buffers are free, so that prefetches never starve demand loads.
+/// The request is queued with negative priority, behind all demand requests.
+/// Return true if the request was made.
+///
+/// @param f File index
+/// @param i Page index
+/// @param t Current time
+/// @param k Priority of the request among prefetches
+
+bool scm_cache::fetch_page(int f, long long i, int t, float k)
+{
+    if (fetches < fetches_per_cycle && int(pbos.size()) > need_queue_size)
+    {
+        if (scm_file *file = sys->get_file(f))
+        {
+            if (!lacks_page(f, i) || waits.find(scm_page(f, i)).is_valid())
+                return false;
+
+            uint64 o = file->get_page_offset(i);
+
+            scm_task task(f, i, o, n, c, b, pbos.deq(), this, -1.f / (1.f + k));
+            scm_page page(f, i, 0);
+
+            if (file->add_need(task))
+            {
+                waits.insert(page, t);
+                fetched[scm_item(f, i)] = task.k;
+                fetches++;
+                fetch_count++;
+                return true;
+            }
+            else
+            {
+                task.dump_page();
+                pbos.enq(task.u);
+            }
+        }
+    }
+    return false;
+}
+
+/// Return true if page i of file f exists and is not loaded, whether or not it
+/// is waiting. A constant page served by a constant line is not lacking. The
+/// page is probed without counting as a use.
+///
+/// @param f File index
+/// @param i Page index
+
+bool scm_cache::lacks_page(int f, long long i)
+{
+    if (scm_file *file = sys->get_file(f))
+    {
+        uint8 v[16];
+
+        if (file->get_page_offset(i) == 0)
+            return false;
+
+        if (const_lines && file->get_page_const(i, v))
+            return false;
+
+        return !pages.find(scm_page(f, i)).is_valid();
+    }
+    return false;
+}
+
+// Return the atlas line holding constant value v, allocating one if needed.
+// Give the time at which it was written in u. A new line is written during the
+// next update, and until then line 0 is returned. Return -1 if no line can be
+// given to the value, in which case the page should be loaded normally.
+
+int scm_cache::get_const(const std::string& v, int t, int& u)
+{
+    std::map<std::string, scm_page>::iterator i = consts.find(v);
+
+    if (i != consts.end())
+    {
+        if (unmade.find(v) != unmade.end())
+        {
+            u = t;
+            return 0;
+        }
+        u = i->second.t;
+        return i->second.l;
+    }
+
+    if (int(consts.size()) < const_lines)
+    {
+        if (int l = get_slot(t, std::numeric_limits<long long>::max()))
+        {
+            consts[v] = scm_page(0, 0, l, t);
+            unmade.insert(v);
+            u = t;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Write constant value v to every pixel of its atlas line, converting as for
+// a loaded page. Return false if no pixel buffer is available.
+
+bool scm_cache::make_const(const std::string& v, int t)
+{
+    if (!pbos.empty())
+    {
+        scm_page& page = consts[v];
+        scm_task  task(0, 0, 0, n, c, b, pbos.deq(), this, 0.f);
+
+        const size_t q = v.size();
+        const size_t r = size_t(n + 2) * size_t(n + 2);
+
+        std::vector<uint8> p(r * q);
+
+        for (size_t k = 0; k < r; ++k)
+            memcpy(&p[k * q], v.data(), q);
+
+        if (task.z || task.e != b || task.v)
+            task.code_page(&p.front());
+        else
+            memcpy(task.p, &p.front(), p.size());
+
+        task.make_page((page.l % s) * m,
+                       (page.l / s) * m);
+        pbos.enq(task.u);
+
+        page.t = t;
+        return true;
+    }
+    return false;
+}
+
+// If page i of file f is a prefetch still queued, raise it to the demand
+// priority k, so that it does not wait behind the other demand loads. It may
+// be in the needs queue of its file or in the loads queue of this cache.
+
+void scm_cache::raise_fetch(scm_file *file, int f, long long i, float k)
+{
+    if (!fetched.empty())
+    {
+        std::map<scm_item, float>::iterator j = fetched.find(scm_item(f, i));
+
+        if (j != fetched.end())
+        {
+            scm_task task(f, i);
+
+            task.k = j->second;
+
+            if (!file->raise_need(task, k))
+                loads.try_update(task, scm_task_priority(k));
+        }
+    }
+}
+
+// Note the demand for page i of file f, counting a hit if it was prefetched.
+
+void scm_cache::use_fetch(int f, long long i)
+{
+    if (!fetched.empty() && fetched.erase(scm_item(f, i)))
+        fetch_hits++;
+}
+
 /// Find a slot for an incoming page
 ///
-/// Either take the next unused slot or eject a page to make room. Return 0
+/// Either take the next unused slot along the atlas curve or eject a page to
+/// make room. Return 0
 // on failure. @see scm_set::eject
 ///
 /// @param t Current time
@@ -229,16 +652,175 @@ int scm_cache::get_page(int f, long long i, int t, int& u)
 
 int scm_cache::get_slot(int t, long long i)
 {
+    if (!frees.empty())
+    {
+        int k = frees.back();
+        frees.pop_back();
+        return k;
+    }
     if (l < s * s)
-        return l++;
+        return lines[l++];
     else
     {
-        scm_page victim = pages.eject(t, i);
+        scm_page victim;
 
-        if (victim.is_valid())
-            return victim.l;
-        else
-            return 0;
+        // Eject pages until one releases its line.
+
+        while (!pages.empty() && (victim = pages.eject(t, i)).is_valid())
+        {
+            if (fetched.erase(victim))
+                fetch_waste++;
+            if (!proxies.empty())
+                proxies.erase(victim);
+            if (free_line(victim.l))
+                return victim.l;
+        }
+        return 0;
+    }
+}
+
+// Release the use of line l by a page leaving the cache. If the line is shared
+// by identical pages, return true only if no other page uses it.
+
+bool scm_cache::free_line(int l)
+{
+    std::map<int, std::pair<uint64, int> >::iterator s = shares.find(l);
+
+    if (s != shares.end())
+    {
+        if (--s->second.second > 0)
+            return false;
+
+        hashes.erase(s->second.first);
+        shares.erase(s);
+    }
+    return true;
+}
+
+// Place an arrived page in the atlas, sharing the line of a resident page of
+// identical content, or taking a line of its own. A prefetched page not yet
+// demanded may displace only stale pages. A page already resident keeps its
+// line.
+
+void scm_cache::add_page(scm_task& task, int t)
+{
+    const bool f = (fetched.find(task) != fetched.end());
+
+    scm_page page(task.f, task.i);
+
+    std::map<uint64, int>::iterator h = (task.y && !task.r)
+                                      ? hashes.find(task.h)
+                                      : hashes.end();
+    waits.remove(page);
+
+    if (pages.search(page, t).is_valid())
+    {
+        // The page is already resident. Write full content over a proxy and
+        // otherwise keep the resident line, so that no second line is taken.
+
+        if (task.r || !fill_proxy(task, t))
+            task.dump_page();
+
+        fetched.erase(task);
+        return;
+    }
+
+    if (task.y && !task.r)
+        dedup_count++;
+
+    if (h != hashes.end())
+    {
+        // Identical content is resident. Share its line.
+
+        page.l = h->second;
+        page.t = t;
+        pages.insert(page, t);
+        shares[page.l].second++;
+        dedup_hits++;
+        task.dump_page();
+    }
+    else if (int l = get_slot(t, f ? std::numeric_limits<long long>::max()
+                                   : page.i))
+    {
+        page.l = l;
+        page.t = t;
+        pages.insert(page, t);
+        task.make_page((l % s) * m,
+                       (l / s) * m);
+        if (task.r)
+        {
+            proxies.insert(page);
+            proxy_count++;
+        }
+        else if (task.y)
+        {
+            hashes[task.h] = l;
+            shares[l] = std::make_pair(task.h, 1);
+        }
+    }
+    else
+    {
+        if (f && fetched.erase(task))
+            fetch_waste++;
+        task.dump_page();
+    }
+}
+
+// Write the full content of task over the proxy of its page, if that page is
+// resident as a proxy. Return false if it is not.
+
+bool scm_cache::fill_proxy(scm_task& task, int t)
+{
+    scm_page page = pages.search(scm_page(task.f, task.i), t);
+
+    if (page.is_valid() && proxies.erase(page))
+    {
+        task.make_page((page.l % s) * m,
+                       (page.l / s) * m);
+        if (task.y && hashes.find(task.h) == hashes.end())
+        {
+            hashes[task.h] = page.l;
+            shares[page.l] = std::make_pair(task.h, 1);
+        }
+        refine_count++;
+        return true;
+    }
+    return false;
+}
+
+// Settle an arrived load, once any group holding it is released. Write the
+// full content of a refinement over its proxy, add a new page, or discard a
+// load that failed, was dropped, or is stale.
+
+void scm_cache::land_page(scm_task& task, int t)
+{
+    if (task.q)
+    {
+        // If the proxy has since been ejected or dropped, the refinement is
+        // stale. A drop noted for it is consumed here unless a new request is
+        // waiting.
+
+        const bool x = !dropped.empty()
+                    && !waits.find(scm_page(task.f, task.i)).is_valid()
+                    && dropped.erase(task);
+
+        refining.erase(task);
+
+        if (x || !task.d || !fill_proxy(task, t))
+            task.dump_page();
+    }
+    else if (!dropped.empty() && dropped.erase(task))
+    {
+        waits.remove(scm_page(task.f, task.i));
+        fetched.erase(task);
+        task.dump_page();
+    }
+    else if (task.d)
+        add_page(task, t);
+    else
+    {
+        fetched.erase(task);
+        task.dump_page();
     }
 }
 
@@ -261,27 +843,65 @@ void scm_cache::update(int t, bool b)
 
     glBindTexture(GL_TEXTURE_2D, texture);
 
+    fetches = 0;
+
+    // Write any newly allocated constant lines.
+
+    while (!unmade.empty() && make_const(*unmade.begin(), t))
+        unmade.erase(unmade.begin());
+
     for (c = 0; (b || c < loads_per_cycle) && loads.try_remove(task); ++c)
     {
-        if (task.d)
+        if (task.g)
+            sys->land_group(task.g);
+
+        // Hold a page of a load group until the group is released.
+
+        if (task.d && task.g)
         {
-            scm_page page(task.f, task.i);
+            held.push_back(task);
+            continue;
+        }
+
+        land_page(task, t);
+        pbos.enq(task.u);
+    }
+
+    // Held loads may keep no more than half of the pixel buffers, so that the
+    // groups of slow loads never starve demand requests. Beyond that, release
+    // the groups of the oldest held loads incomplete.
+
+    for (size_t j = 0; j < held.size()
+                    && int(held.size() - j) > need_queue_size; ++j)
+        sys->break_group(held[j].g);
+}
 
-            waits.remove(page);
+/// Upload the held pages of each load group released by the scm_system. This
+/// is called by the render thread after every cache has been updated, so that
+/// the pages of a group spanning several caches appear in the same frame.
+///
+/// @param t Current time
+
+void scm_cache::release(int t)
+{
+    if (!held.empty())
+    {
+        std::vector<scm_task> keep;
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        for (size_t j = 0; j < held.size(); ++j)
+        {
+            scm_task& task = held[j];
 
-            if (int l = get_slot(t, page.i))
+            if (sys->is_group_done(task.g))
             {
-                page.l = l;
-                page.t = t;
-                pages.insert(page, t);
-                task.make_page((l % s) * (n + 2),
-                               (l / s) * (n + 2));
+                land_page(task, t);
+                pbos.enq(task.u);
             }
-            else task.dump_page();
+            else keep.push_back(task);
         }
-        else task.dump_page();
-
-        pbos.enq(task.u);
+        held.swap(keep);
     }
 }
 
@@ -347,10 +967,65 @@ void scm_cache::render(int ii, int nn)
 
 void scm_cache::flush()
 {
-    while (!pages.empty())
-        pages.eject(0, -1);
+    pages.clear();
+
+    fetched.clear();
+    frees.clear();
+    consts.clear();
+    unmade.clear();
+    hashes.clear();
+    shares.clear();
+    proxies.clear();
 
     l = 1;
 }
 
+/// Pin all pages of level less than l, so that they are never ejected. Set 0 to
+/// pin no pages by level. @see scm_set::eject
+///
+/// @param l Level threshold
+
+void scm_cache::set_pin_level(int l)
+{
+    pages.set_pin_level(l);
+}
+
+/// Pin all pages with the given indices, in every file of this cache, such as
+/// the pages around a point of interest. This replaces any indices previously
+/// given. @see scm_set::eject
+///
+/// @param v Page indices
+
+void scm_cache::set_pin_pages(const std::vector<long long>& v)
+{
+    pages.set_pin_pages(v);
+}
+
+/// Discard page i of file f, whose content has changed, so that it will be
+/// requested anew. A loaded page releases its line for reuse. A waiting page
+/// is discarded when its load arrives, and may be requested anew after that.
+///
+/// @param f File index
+/// @param i Page index
+
+void scm_cache::drop(int f, long long i)
+{
+    scm_page page = pages.find(scm_page(f, i));
+
+    if (page.is_valid())
+    {
+        pages.remove(page);
+
+        if (free_line(page.l))
+            frees.push_back(page.l);
+    }
+
+    if (waits.find(scm_page(f, i)).is_valid() ||
+        refining.find(scm_item(f, i)) != refining.end())
+        dropped.insert(scm_item(f, i));
+
+    fetched.erase(scm_item(f, i));
+    proxies.erase(scm_item(f, i));
+}
+
 //------------------------------------------------------------------------------
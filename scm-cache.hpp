@@ -15,6 +15,8 @@
 
 #include <vector>
 #include <string>
+#include <set>
+#include <map>
 
 #include <GL/glew.h>
 
@@ -31,6 +33,50 @@ class scm_system;
 
 /// An scm_cache is a virtual texture, demand-paged with threaded data access,
 /// represented as a single large OpenGL texture atlas.
+///
+/// In addition to demand requests, the cache accepts speculative prefetch
+/// requests. These are issued at lower priority than any demand request, only
+/// while more than half of the upload buffers are idle, only up to a budget
+/// per cycle, and they occupy only free or stale cache lines. Prefetched pages
+/// later requested on demand count as hits, and if still queued are raised to
+/// demand priority. Those ejected or abandoned before any demand count as
+/// waste.
+///
+/// Unused atlas lines are allocated in the order of a Hilbert curve over the
+/// atlas grid, so that pages loaded together, which tend to be neighbors in
+/// view, occupy a compact region of the texture.
+///
+/// Optionally, 8-bit pages of one to three channels are block compressed by
+/// the loader threads and the atlas uses the matching compressed format. Atlas
+/// lines are then rounded up to a multiple of the 4x4 block size. Likewise,
+/// 32-bit pages may be converted to half floats, halving their atlas memory.
+///
+/// Pages whose catalog extrema are equal are constant. These are not loaded.
+/// Instead, each distinct constant value is written to one atlas line, which
+/// is shared by all constant pages of that value and is never ejected.
+///
+/// Loaded pages are identified by a hash of their content. A page identical to
+/// one already resident shares its atlas line rather than being uploaded, and
+/// a shared line is released only when the last page using it is ejected.
+///
+/// Optionally, the atlas is mipmapped. The loader threads reduce each page to
+/// a few levels, which are uploaded with it. A page line divides evenly at
+/// every level, so a reduced texel never mixes two pages.
+///
+/// Optionally, a page requested on demand is first loaded as a reduced proxy,
+/// decoded from a subset of its TIFF strips. It is shown at once, and its full
+/// content is requested in turn and replaces the proxy in the same line.
+///
+/// Page requests may belong to a load group spanning several caches. A page
+/// of a group is held on arrival and is uploaded only once the scm_system
+/// releases its group, so that all pages of the group appear together. Held
+/// pages keep no more than half of the pixel buffers. Beyond that the oldest
+/// groups are released incomplete.
+///
+/// Pages may be pinned by level or by index, so that the coarse levels that
+/// every view needs, or the pages around points of interest, stay resident.
+/// Pinned pages are never ejected while they hold no more than a set share of
+/// the atlas lines.
 
 class scm_cache
 {
@@ -41,21 +87,55 @@ public:
     static int need_queue_size;
     static int load_queue_size;
     static int loads_per_cycle;
+    static int fetches_per_cycle;
+    static int cache_compress;
+    static int cache_half;
+    static int const_lines;
+    static int cache_dedup;
+    static int cache_mipmaps;
+    static int proxy_stride;
+    static int pin_share;
 
     scm_cache(scm_system *, int, int, int);
    ~scm_cache();
 
     void   add_load(scm_task&);
 
-    int    get_grid_size() const { return s; }
-    int    get_page_size() const { return n; }
+    int    get_grid_size () const { return s; }
+    int    get_page_size () const { return n; }
+    int    get_line_size () const { return m; }
+    int    get_atlas_bits() const { return e; }
+    GLenum get_bcn_form  () const { return z; }
+    bool   get_dedup     () const { return cache_dedup != 0; }
+    int    get_mip_levels() const { return levels; }
+    int  get_proxy_stride() const { return proxy_stride; }
 
     GLuint get_texture() const;
-    int    get_page(int, long long, int, int&);
+    int    get_page(int, long long, int, int&, float, int);
+    int   find_page(int, long long, int, int&);
+    bool fetch_page(int, long long, int, float);
+    bool lacks_page(int, long long);
+
+    int    get_fetch_count() const { return fetch_count; }
+    int    get_fetch_hits () const { return fetch_hits;  }
+    int    get_fetch_waste() const { return fetch_waste; }
+    int    get_const_count() const { return const_count; }
+    int    get_const_lines() const { return int(consts.size()); }
+    int    get_dedup_count() const { return dedup_count; }
+    int    get_dedup_hits () const { return dedup_hits;  }
+    int    get_proxy_count() const { return proxy_count; }
+    int    get_refine_count() const { return refine_count; }
+    int    get_pin_count  () const { return pages.pinned(); }
+    int    get_pin_limit  () const { return pages.get_pin_limit(); }
+
+    void   set_pin_level(int);
+    void   set_pin_pages(const std::vector<long long>&);
 
     void   update(int, bool);
+    void   release(int);
     void   render(int, int);
     void   flush ();
+    void   drop  (int, long long);
 
 private:
 
@@ -68,11 +148,49 @@ private:
     GLuint texture;             // Atlas texture object
     int    s;                   // Atlas width and height in pages
     int    l;                   // Atlas current page
+    std::vector<int> lines;     // Atlas lines in order of allocation
+    std::vector<int> frees;     // Atlas lines released by drop
     int    n;                   // Page width and height in pixels
     int    c;                   // Channels per pixel
     int    b;                   // Bits per channel
-
+    int    e;                   // Bits per channel in the atlas
+    int    m;                   // Atlas line width and height in pixels
+    GLenum z;                   // Compressed internal format, or zero
+    int    levels;              // Atlas mipmap levels beyond the base
+
+    std::map<scm_item, float> fetched; // Prefetched pages not yet demanded,
+                                       // with their request priority
+    std::set<scm_item> dropped; // Waiting pages to be discarded on arrival
+    int    fetches;             // Prefetch requests made this cycle
+    int    fetch_count;         // Total prefetch requests made
+    int    fetch_hits;          // Prefetched pages later demanded
+    int    fetch_waste;         // Prefetched pages never demanded
+
+    std::map<std::string, scm_page> consts; // Atlas lines of constant values
+    std::set<std::string>      unmade; // Constant values not yet written
+    int    const_count;         // Constant page requests served
+
+    std::map<uint64, int>                   hashes; // Line of each content hash
+    std::map<int, std::pair<uint64, int> >  shares; // Hash and users of each line
+    int    dedup_count;         // Hashed pages arrived
+    int    dedup_hits;          // Hashed pages sharing a resident line
+
+    std::set<scm_item> proxies;  // Loaded pages holding a reduced proxy
+    std::set<scm_item> refining; // Proxied pages with full content requested
+    int    proxy_count;         // Proxies arrived
+    int    refine_count;        // Proxies replaced by full content
+
+    std::vector<scm_task> held; // Arrived loads awaiting their group
+
+    void add_page(scm_task&, int);
+    bool fill_proxy(scm_task&, int);
+    void land_page(scm_task&, int);
     int get_slot(int, long long);
+    bool free_line(int);
+    int get_const(const std::string&, int, int&);
+    bool make_const(const std::string&, int);
+    void use_fetch(int, long long);
+    void raise_fetch(scm_file *, int, long long, float);
 };
 
 typedef std::vector<scm_cache *>           scm_cache_v;
@@ -14,6 +14,7 @@
 #include <cstring>
 #include <cstdio>
 #include <cmath>
+#include <algorithm>
 
 #include "util3d/math3d.h"
 #include "scm-index.hpp"
@@ -24,9 +25,44 @@
 
 //------------------------------------------------------------------------------
 
+// Read catalog tag t of TIFF T, with elements of size s, into a newly-allocated
+// buffer. Give the element count in n. Return null on failure.
+
+static void *field(TIFF *T, uint32 t, size_t s, uint64& n)
+{
+    uint64 m = 0;
+    void  *p = 0;
+    void  *q = 0;
+
+    if (TIFFGetField(T, t, &m, &p) && p)
+    {
+        if ((q = malloc(size_t(m) * s)))
+        {
+            memcpy(q, p, size_t(m) * s);
+            n = m;
+        }
+    }
+    return q;
+}
+
+// Copy n bytes of the given buffer into a newly-allocated buffer.
+
+static void *copy(const void *p, size_t n)
+{
+    void *q = 0;
+
+    if (p && n && (q = malloc(n)))
+        memcpy(q, p, n);
+
+    return q;
+}
+
+//------------------------------------------------------------------------------
+
 /// Construct a file table entry
 ///
-/// Open the TIFF briefly to determine its format and cache its meta-data.
+/// Open the TIFF briefly to determine its format and cache its meta-data. If
+/// the file is instead an SCM pack then map it for the life of this object.
 ///
 /// @param name TIFF file name
 /// @param path Fully resolved path and name of TIFF file
@@ -38,21 +74,40 @@ scm_file::scm_file(const std::string& name,
     needs(32),
     active(true),
     sampler(0),
+    pack(0),
+    version(0),
+    catalog(SDL_CreateMutex()),
     w(256), h(256), c(1), b(8),
     xv(0), xc(0),
     ov(0), oc(0),
     av(0), ac(0),
     zv(0), zc(0)
 {
-    // Attempt to find and load the located TIFF.
+    // Attempt to find and load the located SCM pack or TIFF.
 
-    if (!path.empty())
+    if (!path.empty() && scm_pack::test(path))
     {
-        if (TIFF *T = TIFFOpen(path.c_str(), "r"))
+        if ((pack = new scm_pack(path)) && pack->is_valid())
         {
-            uint64 n = 0;
-            void  *p = 0;
+            const uint64 n = pack->get_n();
+
+            w = pack->get_w();
+            h = pack->get_h();
+            c = pack->get_c();
+            b = pack->get_b();
+
+            // Copy the page table, so that it may be treated as a TIFF's.
 
+            if ((xv = (uint64 *) copy(pack->get_x(), size_t(n) * 8))) xc = n;
+            if ((ov = (uint64 *) copy(pack->get_o(), size_t(n) * 8))) oc = n;
+            if ((av = copy(pack->get_a(), size_t(n) * c * b / 8)))    ac = n * c;
+            if ((zv = copy(pack->get_z(), size_t(n) * c * b / 8)))    zc = n * c;
+        }
+    }
+    else if (!path.empty())
+    {
+        if (TIFF *T = TIFFOpen(path.c_str(), "r"))
+        {
             // Cache the image parameters.
 
             TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &w);
@@ -62,38 +117,11 @@ scm_file::scm_file(const std::string& name,
 
             // Preload all metadata.
 
-            if (TIFFGetField(T, 0xFFB1, &n, &p))
-            {
-                if ((xv = (uint64 *) malloc(size_t(n) * sizeof (uint64))))
-                {
-                    memcpy(xv, p, size_t(n) * sizeof (uint64));
-                    xc = n;
-                }
-            }
-            if (TIFFGetField(T, 0xFFB2, &n, &p))
-            {
-                if ((ov = (uint64 *) malloc(size_t(n) * sizeof (uint64))))
-                {
-                    memcpy(ov, p, size_t(n) * sizeof (uint64));
-                    oc = n;
-                }
-            }
-            if (TIFFGetField(T, 0xFFB3, &n, &p))
-            {
-                if ((av = malloc(size_t(n) * size_t(b) / 8)))
-                {
-                    memcpy(av, p, size_t(n) * size_t(b) / 8);
-                    ac = n;
-                }
-            }
-            if (TIFFGetField(T, 0xFFB4, &n, &p))
-            {
-                if ((zv = malloc(size_t(n) * size_t(b) / 8)))
-                {
-                    memcpy(zv, p, size_t(n) * size_t(b) / 8);
-                    zc = n;
-                }
-            }
+            xv = (uint64 *) field(T, 0xFFB1, sizeof (uint64), xc);
+            ov = (uint64 *) field(T, 0xFFB2, sizeof (uint64), oc);
+            av =            field(T, 0xFFB3, size_t(b) / 8,   ac);
+            zv =            field(T, 0xFFB4, size_t(b) / 8,   zc);
+
             TIFFClose(T);
         }
     }
@@ -118,11 +146,14 @@ scm_file::~scm_file()
     // Release all resources.
 
     if (sampler) delete sampler;
+    if (pack)    delete pack;
 
     free(zv);
     free(av);
     free(ov);
     free(xv);
+
+    SDL_DestroyMutex(catalog);
 }
 
 //------------------------------------------------------------------------------
@@ -167,6 +198,102 @@ bool scm_file::is_active() const
     return active.get();
 }
 
+/// Reload the page catalog
+///
+/// Reread the catalog of a file that has been patched in place, and swap it
+/// in. The image parameters must be unchanged. Give the indices of all pages
+/// added, removed, or replaced in v, so that cached copies of them may be
+/// discarded. Return false if the file cannot be reloaded. An SCM pack is
+/// immutable and is never reloaded.
+///
+/// @param v Changed page indices output
+
+bool scm_file::reload(std::vector<long long>& v)
+{
+    v.clear();
+
+    TIFF *T;
+
+    if (pack)
+    {
+        scm_log("scm_file reload %s is an SCM pack", path.c_str());
+        return false;
+    }
+    if (path.empty() || (T = TIFFOpen(path.c_str(), "r")) == 0)
+        return false;
+
+    uint32 W = 0, H = 0;
+    uint16 C = 1, B = 8;
+
+    TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &W);
+    TIFFGetField(T, TIFFTAG_IMAGELENGTH,     &H);
+    TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &B);
+    TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &C);
+
+    if (W != w || H != h || B != b || C != c)
+    {
+        scm_log("scm_file reload %s format mismatch", path.c_str());
+        TIFFClose(T);
+        return false;
+    }
+
+    uint64 nxc = 0, noc = 0, nac = 0, nzc = 0;
+
+    uint64 *nxv = (uint64 *) field(T, 0xFFB1, sizeof (uint64), nxc);
+    uint64 *nov = (uint64 *) field(T, 0xFFB2, sizeof (uint64), noc);
+    void   *nav =            field(T, 0xFFB3, size_t(b) / 8,   nac);
+    void   *nzv =            field(T, 0xFFB4, size_t(b) / 8,   nzc);
+
+    TIFFClose(T);
+
+    SDL_LockMutex(catalog);
+    {
+        // Merge the old and new catalogs, noting differing pages.
+
+        uint64 i = 0;
+        uint64 j = 0;
+
+        while (i < xc || j < nxc)
+        {
+            if      (j == nxc || (i < xc && xv[i] < nxv[j]))
+                v.push_back((long long) xv[i++]);
+            else if (i ==  xc || (j < nxc && nxv[j] < xv[i]))
+                v.push_back((long long) nxv[j++]);
+            else
+            {
+                if ((i < oc ? ov[i] : 0) != (j < noc ? nov[j] : 0))
+                    v.push_back((long long) xv[i]);
+                i++;
+                j++;
+            }
+        }
+
+        // Swap in the new catalog.
+
+        std::swap(xv, nxv); std::swap(xc, nxc);
+        std::swap(ov, nov); std::swap(oc, noc);
+        std::swap(av, nav); std::swap(ac, nac);
+        std::swap(zv, nzv); std::swap(zc, nzc);
+    }
+    SDL_UnlockMutex(catalog);
+
+    free(nzv);
+    free(nav);
+    free(nov);
+    free(nxv);
+
+    // Signal the loaders and the sampler to reopen the file.
+
+    version.set(version.get() + 1);
+
+    if (sampler)
+        sampler->reopen();
+
+    scm_log("scm_file reload %s %d pages changed", path.c_str(), int(v.size()));
+
+    return true;
+}
+
 /// Insert a new loader task into the needs queue.
 
 bool scm_file::add_need(scm_task& task)
@@ -174,6 +301,14 @@ bool scm_file::add_need(scm_task& task)
     return needs.try_insert(task);
 }
 
+/// Change the priority of a loader task still in the needs queue to k. Return
+/// false if the task is not queued, having been taken by a loader thread.
+
+bool scm_file::raise_need(const scm_task& task, float k)
+{
+    return needs.try_update(task, scm_task_priority(k));
+}
+
 //------------------------------------------------------------------------------
 
 // Determine whether page i is given by this file. If no catalog exists then
@@ -181,14 +316,16 @@ bool scm_file::add_need(scm_task& task)
 
 bool scm_file::get_page_status(uint64 i) const
 {
-    if (xc)
+    bool s = true;
+
+    SDL_LockMutex(catalog);
     {
-        if (toindex(i) < xc)
-            return true;
-        else
-            return false;
+        if (xc)
+            s = (toindex(i) < xc);
     }
-    return true;
+    SDL_UnlockMutex(catalog);
+
+    return s;
 }
 
 // Seek page i in the page catalog and return its file offset. Return zero
@@ -196,17 +333,23 @@ bool scm_file::get_page_status(uint64 i) const
 
 uint64 scm_file::get_page_offset(uint64 i) const
 {
-    if (oc)
-    {
-        uint64 oj;
+    uint64 o = (uint64) (-1);
 
-        if ((oj = toindex(i)) < oc)
+    SDL_LockMutex(catalog);
+    {
+        if (oc)
         {
-            return ov[oj];
+            uint64 oj;
+
+            if ((oj = toindex(i)) < oc)
+                o = ov[oj];
+            else
+                o = 0;
         }
-        return 0;
     }
-    return (uint64) (-1);
+    SDL_UnlockMutex(catalog);
+
+    return o;
 }
 
 // Determine the min and max values of page i. Seek it in the page catalog and
@@ -215,6 +358,8 @@ uint64 scm_file::get_page_offset(uint64 i) const
 
 void scm_file::get_page_bounds(uint64 i, float& r0, float& r1) const
 {
+    SDL_LockMutex(catalog);
+
     if (ac && zc)
     {
         uint64 aj = (uint64) (-1);
@@ -241,6 +386,37 @@ void scm_file::get_page_bounds(uint64 i, float& r0, float& r1) const
         r0 = 0.5f;
         r1 = 0.5f;
     }
+
+    SDL_UnlockMutex(catalog);
+}
+
+// Determine whether page i is constant, as given by equal minima and maxima
+// in the page catalog. If so, copy its value, c samples of b bits, to v.
+
+bool scm_file::get_page_const(uint64 i, void *v) const
+{
+    bool r = false;
+
+    SDL_LockMutex(catalog);
+    {
+        const uint64 j = toindex(i);
+        const size_t s = size_t(c) * b / 8;
+
+        if (j < xc && (j + 1) * c <= ac && (j + 1) * c <= zc)
+        {
+            const uint8 *a = (const uint8 *) av + j * s;
+            const uint8 *z = (const uint8 *) zv + j * s;
+
+            if (memcmp(a, z, s) == 0)
+            {
+                memcpy(v, a, s);
+                r = true;
+            }
+        }
+    }
+    SDL_UnlockMutex(catalog);
+
+    return r;
 }
 
 // Sample this file along vector v using linear filtering.
@@ -257,6 +433,81 @@ float scm_file::get_page_sample(const double *v)
     return 0.5f;
 }
 
+// Sample this file along n vectors v, giving results in k.
+
+void scm_file::get_page_sample(const double *v, float *k, int n)
+{
+    if (xc)
+    {
+        if (sampler == 0)
+            sampler = new scm_sample(this);
+
+        if (sampler)
+            sampler->get(v, k, n);
+        else
+            std::fill(k, k + n, 1.f);
+    }
+    else std::fill(k, k + n, 0.5f);
+}
+
+// Estimate the sample along vector v using only the page catalog, giving the
+// maximum of the deepest page containing v.
+
+float scm_file::get_page_guess(const double *v) const
+{
+    if (xc)
+    {
+        long long a;
+        double    y;
+        double    x;
+        float     r0;
+        float     r1;
+
+        scm_locate(&a, &y, &x, v);
+
+        get_page_bounds(uint64(find_index(a, y, 1 - x)), r0, r1);
+
+        return r1;
+    }
+    return 0.5f;
+}
+
+// Begin an asynchronous sample of this file along vector v, to be identified
+// by i, and return an immediate estimate of the result in k. Return true if
+// the query was queued, or false if the estimate is the only result.
+
+bool scm_file::query_page_sample(int i, const double *v, float& k)
+{
+    bool b = false;
+
+    if (xc)
+    {
+        if (sampler == 0)
+            sampler = new scm_sample(this);
+
+        k = sampler ? sampler->put(i, v, b) : 1.f;
+    }
+    else k = 0.5f;
+
+    return b;
+}
+
+// Retrieve the result of a completed asynchronous sample. Return false if
+// there is none.
+
+bool scm_file::result_page_sample(int& i, float& k)
+{
+    scm_query query;
+
+    if (sampler && sampler->pop(query))
+    {
+        i = query.id;
+        k = query.k;
+        return true;
+    }
+    return false;
+}
+
 //------------------------------------------------------------------------------
 
 // Compare two uint64s, for use by bsearch and qsort.
@@ -323,7 +574,11 @@ uint64 scm_file::find_page(long long a, double& y, double& x) const
     long long n = 1;
     long long l = 1;
     uint64    j = 0;
-    uint64    o = ov[a];
+    uint64    o;
+
+    SDL_LockMutex(catalog);
+
+    o = ov[a];
 
     while ((j = toindex(scm_page_index(a, l, int(2 * n * y),
                                              int(2 * n * x)))) < oc)
@@ -335,12 +590,88 @@ uint64 scm_file::find_page(long long a, double& y, double& x) const
         }
         else break;
 
+    SDL_UnlockMutex(catalog);
+
     x = (x * n) - floor(x * n);
     y = (y * n) - floor(y * n);
 
     return o;
 }
 
+// Determine the index of the deepest page of root a present in this file that
+// includes the root face coordinate (y, x).
+
+long long scm_file::find_index(long long a, double y, double x) const
+{
+    long long n = 1;
+    long long l = 1;
+    long long i = a;
+    long long k;
+    uint64    j;
+
+    SDL_LockMutex(catalog);
+
+    while ((j = toindex(k = scm_page_index(a, l, int(2 * n * y),
+                                                 int(2 * n * x)))) < oc)
+        if (ov[j])
+        {
+            i = k;
+            l = l + 1;
+            n = n * 2;
+        }
+        else break;
+
+    SDL_UnlockMutex(catalog);
+
+    return i;
+}
+
+/// Return the number of entries in the page catalog.
+
+uint64 scm_file::get_page_count() const
+{
+    uint64 n;
+
+    SDL_LockMutex(catalog);
+    n = xc;
+    SDL_UnlockMutex(catalog);
+
+    return n;
+}
+
+/// Return the page index of catalog entry k, or -1 if there is none.
+
+uint64 scm_file::get_page_index(uint64 k) const
+{
+    uint64 i = (uint64) (-1);
+
+    SDL_LockMutex(catalog);
+    {
+        if (k < xc)
+            i = xv[k];
+    }
+    SDL_UnlockMutex(catalog);
+
+    return i;
+}
+
+/// Give the per-channel minima and maxima of catalog entry k in a and z, each
+/// of which must have room for one value per channel. Give zero for any value
+/// missing from the catalog.
+
+void scm_file::get_page_range(uint64 k, float *a, float *z) const
+{
+    SDL_LockMutex(catalog);
+    {
+        for (uint64 d = 0; d < c; ++d)
+        {
+            a[d] = (k * c + d < ac) ? tofloat(av, k * c + d) : 0.f;
+            z[d] = (k * c + d < zc) ? tofloat(zv, k * c + d) : 0.f;
+        }
+    }
+    SDL_UnlockMutex(catalog);
+}
+
 //------------------------------------------------------------------------------
 
 // This defines an 8x8 bitmap font used to write text directly to images.
@@ -525,11 +856,10 @@ void scm_page_text(const char *mesg,
     set_text(diag, w / 2 - dsz * 4, h / 3 +  6, w, h, c, b, p);
 }
 
-/// Load a page from a TIFF file
+/// Read a page from a TIFF file
 ///
-/// Confirm the image parameters and return success.
-/// @param name TIFF name
-/// @param i    Page index
+/// Confirm the image parameters and decode the page. Return null on success,
+/// or a description of the failure.
 /// @param T    TIFF file
 /// @param o    TIFF offset
 /// @param w    Page width
@@ -538,8 +868,7 @@ void scm_page_text(const char *mesg,
 /// @param b    Page bits per channel
 /// @param p    Destination pixel buffer
 
-bool scm_load_page(const char *name, long long i,
-                         TIFF *T, uint64 o, int w, int h, int c, int b, void *p)
+const char *scm_read_page(TIFF *T, uint64 o, int w, int h, int c, int b, void *p)
 {
     if (T)
     {
@@ -561,17 +890,212 @@ bool scm_load_page(const char *name, long long i,
                 for (int l = 0; l < N; ++l)
                 {
                     if (TIFFReadEncodedStrip(T, l, (uint8 *) p + l * S, -1) == -1)
-                    {
-                        scm_page_text("Page read failure", name, i, W, H, C, B, p);
-                        break;
-                    }
+                        return "Page read failure";
                 }
+                return 0;
             }
-            else scm_page_text("Bad page format", name, i, W, H, C, B, p);
+            else return "Bad page format";
         }
-        else scm_page_text("Page not found", name, i, w, h, c, b, p);
+        else return "Page not found";
     }
-    else scm_page_text("File not found", name, i, w, h, c, b, p);
+    else return "File not found";
+}
+
+// Fill n samples of row d by linear interpolation of rows a and z at parameter
+// t, adding bias r before conversion to round integer samples.
+
+template <typename T> static void blend(const T *a, const T *z, T *d,
+                                        size_t n, double t, double r)
+{
+    for (size_t k = 0; k < n; ++k)
+        d[k] = T(a[k] * (1.0 - t) + z[k] * t + r);
+}
+
+// Interpolate rows of b-bit samples, as above.
+
+static void interpolate(const void *a, const void *z, void *d,
+                        size_t n, int b, double t)
+{
+    switch (b)
+    {
+    case  8: blend((const uint8  *) a, (const uint8  *) z, (uint8  *) d, n, t, 0.5); break;
+    case 16: blend((const uint16 *) a, (const uint16 *) z, (uint16 *) d, n, t, 0.5); break;
+    case 32: blend((const float  *) a, (const float  *) z, (float  *) d, n, t, 0.0); break;
+    }
+}
+
+/// Read a reduced proxy of a page from a TIFF file
+///
+/// Decode only every k-th strip of the page, and the last, and fill the rows
+/// between by linear interpolation, at roughly 1/k the cost of a full read.
+/// If the page has too few strips for this to help, read it in full and clear
+/// r. Return null on success, or a description of the failure.
+/// @param T    TIFF file
+/// @param o    TIFF offset
+/// @param w    Page width
+/// @param h    Page height
+/// @param c    Page channels per pixel
+/// @param b    Page bits per channel
+/// @param k    Strip stride
+/// @param r    Proxy flag, cleared if the full page is read
+/// @param p    Destination pixel buffer
+
+const char *scm_read_proxy(TIFF *T, uint64 o, int w, int h, int c, int b,
+                                              int k, bool& r, void *p)
+{
+    if (T && k > 1 && TIFFSetSubDirectory(T, o))
+    {
+        uint32 W, H, R;
+        uint16 C, B;
+
+        TIFFGetField(T, TIFFTAG_IMAGEWIDTH,      &W);
+        TIFFGetField(T, TIFFTAG_IMAGELENGTH,     &H);
+        TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &B);
+        TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &C);
+
+        TIFFGetFieldDefaulted(T, TIFFTAG_ROWSPERSTRIP, &R);
+
+        tsize_t N = TIFFNumberOfStrips(T);
+        tsize_t S = TIFFStripSize(T);
+
+        if (int(W) == w && int(H) == h && int(B) == b && int(C) == c
+                                       && R > 0 && N >= 2 * k)
+        {
+            const size_t s = size_t(w) * c * b / 8;
+
+            std::vector<bool> have(h, false);
+
+            // Decode every k-th strip and the last.
+
+            for (tsize_t l = 0; l < N; l = (l + k < N || l == N - 1) ? l + k : N - 1)
+            {
+                if (TIFFReadEncodedStrip(T, l, (uint8 *) p + l * S, -1) == -1)
+                    return "Page read failure";
+
+                for (int y = int(l * R); y < int((l + 1) * R) && y < h; ++y)
+                    have[y] = true;
+            }
+
+            // Interpolate the rows between them.
+
+            for (int y0 = 0, y1; y0 < h; y0 = y1)
+            {
+                for (y1 = y0 + 1; y1 < h && !have[y1]; ++y1)
+                    ;
+                if (y1 < h)
+                    for (int y = y0 + 1; y < y1; ++y)
+                        interpolate((const uint8 *) p + y0 * s,
+                                    (const uint8 *) p + y1 * s,
+                                    (      uint8 *) p + y  * s, size_t(w) * c, b,
+                                    double(y - y0) / double(y1 - y0));
+            }
+            return 0;
+        }
+    }
+    r = false;
+    return scm_read_page(T, o, w, h, c, b, p);
+}
+
+/// Read a page from an SCM pack
+///
+/// Confirm the image parameters and decode the page. Return null on success,
+/// or a description of the failure.
+/// @param P    SCM pack
+/// @param o    Page payload offset
+/// @param w    Page width
+/// @param h    Page height
+/// @param c    Page channels per pixel
+/// @param b    Page bits per channel
+/// @param p    Destination pixel buffer
+
+const char *scm_read_page(const scm_pack *P, uint64 o, int w, int h, int c, int b,
+                                                                        void *p)
+{
+    if (P && P->is_valid())
+    {
+        if (int(P->get_w()) == w && int(P->get_h()) == h &&
+            int(P->get_c()) == c && int(P->get_b()) == b)
+        {
+            if (P->load(o, p))
+                return 0;
+            else
+                return "Page read failure";
+        }
+        else return "Bad page format";
+    }
+    else return "File not found";
+}
+
+/// Load a page from a TIFF file
+///
+/// Read the page, or on failure write a diagnostic message to the page, and
+/// return success. @see scm_read_page
+/// @param name TIFF name
+/// @param i    Page index
+/// @param T    TIFF file
+/// @param o    TIFF offset
+/// @param w    Page width
+/// @param h    Page height
+/// @param c    Page channels per pixel
+/// @param b    Page bits per channel
+/// @param p    Destination pixel buffer
+
+bool scm_load_page(const char *name, long long i,
+                         TIFF *T, uint64 o, int w, int h, int c, int b, void *p)
+{
+    if (const char *e = scm_read_page(T, o, w, h, c, b, p))
+        scm_page_text(e, name, i, w, h, c, b, p);
+
+    return true;
+}
+
+/// Load a reduced proxy of a page from a TIFF file
+///
+/// Read the proxy, or on failure write a diagnostic message to the page, and
+/// return success. @see scm_read_proxy
+/// @param name TIFF name
+/// @param i    Page index
+/// @param T    TIFF file
+/// @param o    TIFF offset
+/// @param w    Page width
+/// @param h    Page height
+/// @param c    Page channels per pixel
+/// @param b    Page bits per channel
+/// @param k    Strip stride
+/// @param r    Proxy flag, cleared if the full page is read
+/// @param p    Destination pixel buffer
+
+bool scm_load_proxy(const char *name, long long i,
+                          TIFF *T, uint64 o, int w, int h, int c, int b,
+                                             int k, bool& r, void *p)
+{
+    if (const char *e = scm_read_proxy(T, o, w, h, c, b, k, r, p))
+    {
+        scm_page_text(e, name, i, w, h, c, b, p);
+        r = false;
+    }
+    return true;
+}
+
+/// Load a page from an SCM pack
+///
+/// Read the page, or on failure write a diagnostic message to the page, and
+/// return success. @see scm_read_page
+/// @param name Pack name
+/// @param i    Page index
+/// @param P    SCM pack
+/// @param o    Page payload offset
+/// @param w    Page width
+/// @param h    Page height
+/// @param c    Page channels per pixel
+/// @param b    Page bits per channel
+/// @param p    Destination pixel buffer
+
+bool scm_load_page(const char *name, long long i,
+                   const scm_pack *P, uint64 o, int w, int h, int c, int b, void *p)
+{
+    if (const char *e = scm_read_page(P, o, w, h, c, b, p))
+        scm_page_text(e, name, i, w, h, c, b, p);
 
     return true;
 }
@@ -590,13 +1114,27 @@ int loader(void *data)
     scm_log("loader thread begin %s", file->path.c_str());
     {
         const char *name = file->path.c_str();
-        TIFF       *tiff = TIFFOpen(name, "r");
+        TIFF       *tiff = file->pack ? 0 : TIFFOpen(name, "r");
+        int         vers = file->version.get();
 
         while ((task = file->needs.remove()).f >= 0)
 
             if (file->is_active())
             {
-                task.load_page(name, tiff);
+                // If the catalog has been reloaded, reopen the file to
+                // observe any pages appended since it was opened.
+
+                if (vers != file->version.get())
+                {
+                    vers  = file->version.get();
+                    if (tiff) TIFFClose(tiff);
+                    tiff  = TIFFOpen(name, "r");
+                }
+
+                if (file->pack)
+                    task.load_page(name, file->pack);
+                else
+                    task.load_page(name, tiff);
                 file->cache->add_load(task);
             }
             else break;
@@ -24,6 +24,7 @@
 #include "scm-guard.hpp"
 #include "scm-task.hpp"
 #include "scm-sample.hpp"
+#include "scm-pack.hpp"
 
 //------------------------------------------------------------------------------
 
@@ -33,6 +34,13 @@ typedef std::vector<SDL_Thread *>::iterator thread_i;
 //------------------------------------------------------------------------------
 
 /// An scm_file encapsulates an open SCM data file.
+///
+/// The file may be an SCM TIFF or an SCM pack. An SCM pack is memory-mapped
+/// and its pages are loaded without libtiff. @see scm_pack
+///
+/// The page catalog may be reloaded while the file is in use, after the file
+/// has been patched in place. Catalog access is serialized by a mutex, and the
+/// loader threads reopen the file when they notice that it has been reloaded.
 
 class scm_file
 {
@@ -46,13 +54,21 @@ public:
     void    activate(scm_cache *);
     void  deactivate();
     bool is_active() const;
+    bool    reload(std::vector<long long>&);
 
     bool           add_need(scm_task&);
+    bool         raise_need(const scm_task&, float);
 
     virtual bool   get_page_status(uint64)                 const;
     virtual uint64 get_page_offset(uint64)                 const;
     virtual void   get_page_bounds(uint64, float&, float&) const;
+    virtual bool   get_page_const (uint64, void *)         const;
     virtual float  get_page_sample(const double *);
+    virtual void   get_page_sample(const double *, float *, int);
+    virtual float  get_page_guess (const double *)         const;
+
+    bool         query_page_sample(int, const double *, float&);
+    bool        result_page_sample(int&, float&);
 
     virtual uint32 get_w()    const { return w; }
     virtual uint32 get_h()    const { return h; }
@@ -61,8 +77,14 @@ public:
 
     const char    *get_path() const { return path.c_str(); }
     const char    *get_name() const { return name.c_str(); }
+    const scm_pack *get_pack() const { return pack; }
 
     uint64        find_page(long long, double&, double&) const;
+    long long    find_index(long long, double,  double)  const;
+
+    uint64   get_page_count()                          const;
+    uint64   get_page_index(uint64)                    const;
+    void     get_page_range(uint64, float *, float *)  const;
 
 protected:
 
@@ -77,7 +99,10 @@ private:
     scm_queue<scm_task> needs;
     scm_guard<bool>     active;
     scm_sample         *sampler;
+    scm_pack           *pack;
     thread_v            threads;
+    scm_guard<int>      version;
+    SDL_mutex          *catalog;
 
     // Image parameters
 
@@ -109,8 +134,16 @@ private:
 //------------------------------------------------------------------------------
 /// @file
 
+const char *scm_read_page(      TIFF *, uint64, int, int, int, int, void *);
+const char *scm_read_page(const scm_pack *, uint64, int, int, int, int, void *);
+const char *scm_read_proxy(     TIFF *, uint64, int, int, int, int, int, bool&, void *);
+
 bool scm_load_page(const char *, long long,
                          TIFF *, uint64, int, int, int, int, void *);
+bool scm_load_page(const char *, long long,
+             const scm_pack *, uint64, int, int, int, int, void *);
+bool scm_load_proxy(const char *, long long,
+                          TIFF *, uint64, int, int, int, int, int, bool&, void *);
 
 //------------------------------------------------------------------------------
 
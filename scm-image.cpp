@@ -148,7 +148,7 @@ void scm_image::bind(GLuint unit, GLuint program) const
     if (cache)
     {
         const GLfloat r = GLfloat(cache->get_page_size())
-                        / GLfloat(cache->get_page_size() + 2)
+                        / GLfloat(cache->get_line_size())
                         / GLfloat(cache->get_grid_size());
 
         glUniform2f(ur,  r, r);
@@ -178,9 +178,10 @@ void scm_image::bind_page(GLuint program, int d, int t, long long i) const
 {
     if (cache)
     {
-        // Get the page index and the time of its loading.
+        // Get the page index and the time of its loading. The page was
+        // requested, if necessary, when it was touched.
 
-        int u, l = cache->get_page(index, i, t, u);
+        int u, l = cache->find_page(index, i, t, u);
 
         // Compute the page age.
 
@@ -196,11 +197,11 @@ void scm_image::bind_page(GLuint program, int d, int t, long long i) const
         // Compute texture coordinate offsets and set the uniforms.
 
         const int s = cache->get_grid_size();
-        const int n = cache->get_page_size();
+        const int m = cache->get_line_size();
 
         glUniform1f(ua[d], GLfloat(a));
-        glUniform2f(ub[d], GLfloat((l % s) * (n + 2) + 1) / (s * (n + 2)),
-                           GLfloat((l / s) * (n + 2) + 1) / (s * (n + 2)));
+        glUniform2f(ub[d], GLfloat((l % s) * m + 1) / (s * m),
+                           GLfloat((l / s) * m + 1) / (s * m));
     }
 }
 
@@ -213,19 +214,55 @@ void scm_image::unbind_page(GLuint program, int d) const
     glUniform2f(ub[d], 0.f, 0.f);
 }
 
-/// Set the last-used time of a page.
+/// Set the last-used time of a page, requesting it with priority k as part of
+/// load group g if it is not yet loaded.
 
-void scm_image::touch_page(int t, long long i) const
+void scm_image::touch_page(int t, long long i, float k, int g) const
 {
     if (cache)
     {
         int ignored;
-        cache->get_page(index, i, t, ignored);
+        cache->get_page(index, i, t, ignored, k, g);
     }
 }
 
+/// Request a page speculatively, in anticipation of its future use.
+
+void scm_image::fetch_page(int t, long long i, float k) const
+{
+    if (cache)
+        cache->fetch_page(index, i, t, k);
+}
+
 //------------------------------------------------------------------------------
 
+/// Begin an asynchronous sample of this image on behalf of ground query q,
+/// returning a normalized estimate. @see scm_system::query_page_sample
+
+float scm_image::query_page_sample(const double *v, int q) const
+{
+    if (index < 0)
+        return k1;
+    else
+        return sys->query_page_sample(index, q, v, k0, k1) * (k1 - k0) + k0;
+}
+
+/// Sample this image at n locations, giving normalized results in k.
+/// @see scm_scene::get_current_ground
+
+void scm_image::get_page_sample(const double *v, float *k, int n) const
+{
+    if (index < 0)
+        std::fill(k, k + n, k1);
+    else
+    {
+        sys->get_page_sample(index, v, k, n);
+
+        for (int i = 0; i < n; ++i)
+            k[i] = k[i] * (k1 - k0) + k0;
+    }
+}
+
 /// Sample this image at the given location, returning a normalized result.
 /// @see scm_scene::get_page_sample
 
@@ -71,9 +71,12 @@ public:
 
     void   bind_page(GLuint, int, int, long long) const;
     void unbind_page(GLuint, int)                 const;
-    void  touch_page(             int, long long) const;
+    void  touch_page(             int, long long, float, int) const;
+    void  fetch_page(             int, long long, float) const;
 
     float   get_page_sample(const double *)              const;
+    void    get_page_sample(const double *, float *, int) const;
+    float query_page_sample(const double *, int)         const;
     void    get_page_bounds(long long, float &, float &) const;
     bool    get_page_status(long long)                   const;
 
@@ -90,119 +90,219 @@ void scm_locate(long long *a, double *y, double *x, const double *v)
     *y = (t + M_PI_4) / M_PI_2;
 }
 
-// Determine the page to the north of page i. ----------------------------------
+// The batch forms of scm_vector and scm_locate below are written as straight-
+// line loops with table lookups in place of switches and polynomials in place
+// of library trig so that the compiler may vectorize them. They agree with the
+// scalar forms above to within a few ulps over the full sphere.
 
-long long scm_page_north(long long i)
+// Signed permutations taking world vectors to face-local vectors. -------------
+
+static const int    face_axis[6][3] = {
+    { 2, 1, 0 }, { 2, 1, 0 }, { 0, 2, 1 }, { 0, 2, 1 }, { 0, 1, 2 }, { 0, 1, 2 }
+};
+static const double face_sign[6][3] = {
+    { -1,  1,  1 }, {  1,  1, -1 }, {  1, -1,  1 },
+    {  1,  1, -1 }, {  1,  1,  1 }, { -1,  1, -1 }
+};
+
+// Approximate tan(x) for |x| <= pi/4 using the Cephes rational polynomial. ----
+
+static inline double scm_tan(double x)
+{
+    const double z = x * x;
+
+    const double p = (( -1.30936939181383777646e+4  * z
+                       + 1.15351664838587416140e+6) * z
+                       - 1.79565251976484877988e+7);
+    const double q = (((                              z
+                       + 1.36812963470692954678e+4) * z
+                       - 1.32089234440210967447e+6) * z
+                       + 2.50083801823357915839e+7) * z
+                       - 5.38695755929454629881e+7;
+
+    return x + x * z * p / q;
+}
+
+// Approximate atan(x) for |x| <= 1 using the Cephes rational polynomial. ------
+
+static inline double scm_atan(double x)
 {
-    long long l = scm_page_level(i);
-    long long a = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    // Reduce arguments beyond tan(pi/8) using atan(x) = pi/4 + atan(x').
+
+    const double a = fabs(x);
+    const bool   b = (a > 0.66);
+    const double w = b ? (a - 1.0) / (a + 1.0) : a;
+    const double o = b ? M_PI_4 + 3.061616997868382943065e-17 : 0.0;
+    const double z = w * w;
+
+    const double p = ((((-8.750608600031904122785e-1  * z
+                        - 1.615753718733365076637e+1) * z
+                        - 7.500855792314704667340e+1) * z
+                        - 1.228866684490136173410e+2) * z
+                        - 6.485021904942025371773e+1);
+    const double q = ((((                               z
+                        + 2.485846490142306297962e+1) * z
+                        + 1.650270098316988542046e+2) * z
+                        + 4.328810604912902668951e+2) * z
+                        + 4.853903996359136964868e+2) * z
+                        + 1.945506571482613964425e+2;
+
+    const double r = o + w + w * z * p / q;
+
+    return (x < 0) ? -r : r;
+}
+
+/// Calculate n vectors v toward (x, y) on root faces a. This is the batch form
+/// of scm_vector. The face-local vector (sin s cos t, -cos s sin t, cos s cos t)
+/// is parallel to (tan s, -tan t, 1), so one tangent per coordinate suffices.
 
-    long long n = 1LL << l, m = n - 1, t = m - c;
+void scm_vector(const long long *a, const double *y,
+                const double    *x,       double *v, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        const double s = scm_tan(x[i] * M_PI_2 - M_PI_4);
+        const double t = scm_tan(y[i] * M_PI_2 - M_PI_4);
+        const double k = 1.0 / sqrt(s * s + t * t + 1.0);
 
-    if      (r >  0) {        r = r - 1;    }
-    else if (a == 0) { a = 2; r = t; c = m; }
-    else if (a == 1) { a = 2; r = c; c = 0; }
-    else if (a == 2) { a = 5; r = 0; c = t; }
-    else if (a == 3) { a = 4; r = m;        }
-    else if (a == 4) { a = 2; r = m;        }
-    else             { a = 2; r = 0; c = t; }
+        const int    *A = face_axis[a[i]];
+        const double *S = face_sign[a[i]];
 
-    return scm_page_index(a, l, r, c);
+        v[3 * i + A[0]] =  S[0] * s * k;
+        v[3 * i + A[1]] = -S[1] * t * k;
+        v[3 * i + A[2]] =  S[2]     * k;
+    }
 }
 
-// Determine the page to the south of page i. ----------------------------------
+/// Calculate the root faces a and coordinates (x, y) along n vectors v. This is
+/// the batch form of scm_locate. Vectors lying exactly between two faces, which
+/// the scalar form leaves unassigned, are given to the face of the lower axis.
 
-long long scm_page_south(long long i)
+void scm_locate(long long *a, double *y, double *x, const double *v, int n)
 {
-    long long l = scm_page_level(i);
-    long long a = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    for (int i = 0; i < n; ++i)
+    {
+        const double X = v[3 * i + 0], ax = fabs(X);
+        const double Y = v[3 * i + 1], ay = fabs(Y);
+        const double Z = v[3 * i + 2], az = fabs(Z);
+
+        const long long f = (ax >= ay && ax >= az) ? 0 + (X < 0) :
+                            (ay >= az)             ? 2 + (Y < 0) :
+                                                     4 + (Z < 0);
 
-    long long n = 1LL << l, m = n - 1, t = m - c;
+        const int    *A = face_axis[f];
+        const double *S = face_sign[f];
 
-    if      (r <  m) {        r = r + 1;    }
-    else if (a == 0) { a = 3; r = c; c = m; }
-    else if (a == 1) { a = 3; r = t; c = 0; }
-    else if (a == 2) { a = 4; r = 0;        }
-    else if (a == 3) { a = 5; r = m; c = t; }
-    else if (a == 4) { a = 3; r = 0;        }
-    else             { a = 3; r = m; c = t; }
+        const double u0 = S[0] * v[3 * i + A[0]];
+        const double u1 = S[1] * v[3 * i + A[1]];
+        const double u2 = S[2] * v[3 * i + A[2]];
 
-    return scm_page_index(a, l, r, c);
+        a[i] = f;
+        x[i] = 0.5 - scm_atan(u0 / u2) / M_PI_2;
+        y[i] = 0.5 - scm_atan(u1 / u2) / M_PI_2;
+    }
 }
 
-// Determine the page to the west of page i. -----------------------------------
+// Neighbor lookup across the edges of the root faces. When a step leaves the
+// face, the table gives the root face entered, and selects its row and column
+// from the candidates 0, m, r, c, m - r, and m - c, where m is the last row.
 
-long long scm_page_west(long long i)
+struct scm_edge
 {
-    long long l = scm_page_level(i);
-    long long a = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    int a;
+    int r;
+    int c;
+};
+
+static const scm_edge north_edge[6] = {
+    { 2, 5, 1 }, { 2, 3, 0 }, { 5, 0, 5 }, { 4, 1, 3 }, { 2, 1, 3 }, { 2, 0, 5 }
+};
+static const scm_edge south_edge[6] = {
+    { 3, 3, 1 }, { 3, 5, 0 }, { 4, 0, 3 }, { 5, 1, 5 }, { 3, 0, 3 }, { 3, 1, 5 }
+};
+static const scm_edge west_edge[6] = {
+    { 4, 2, 1 }, { 5, 2, 1 }, { 1, 0, 2 }, { 1, 1, 4 }, { 1, 2, 1 }, { 0, 2, 1 }
+};
+static const scm_edge east_edge[6] = {
+    { 5, 2, 0 }, { 4, 2, 0 }, { 0, 0, 4 }, { 0, 1, 2 }, { 0, 2, 0 }, { 1, 2, 0 }
+};
+
+// Determine the page one step of (dr, dc) from page i. ------------------------
+
+static inline long long scm_page_step(long long i, const scm_edge *E,
+                                      long long dr, long long dc)
+{
+    long long a, l, r, c;
+
+    scm_page_decode(i, a, l, r, c);
+
+    const long long m = (1LL << l) - 1;
+    const long long R = r + dr;
+    const long long C = c + dc;
 
-    long long n = 1LL << l, m = n - 1, t = m - r;
+    if (0 <= R && R <= m && 0 <= C && C <= m)
+        return scm_page_index(a, l, R, C);
+    else
+    {
+        const long long w[6] = { 0, m, r, c, m - r, m - c };
+        const scm_edge& e    = E[a];
+
+        return scm_page_index(e.a, l, w[e.r], w[e.c]);
+    }
+}
 
-    if      (c >  0) {        c = c - 1;    }
-    else if (a == 0) { a = 4; c = m;        }
-    else if (a == 1) { a = 5; c = m;        }
-    else if (a == 2) { a = 1; c = r; r = 0; }
-    else if (a == 3) { a = 1; c = t; r = m; }
-    else if (a == 4) { a = 1; c = m;        }
-    else             { a = 0; c = m;        }
+// Determine the page to the north of page i. ----------------------------------
 
-    return scm_page_index(a, l, r, c);
+long long scm_page_north(long long i)
+{
+    return scm_page_step(i, north_edge, -1,  0);
 }
 
-// Determine the page to the east of page i. -----------------------------------
+// Determine the page to the south of page i. ----------------------------------
 
-long long scm_page_east(long long i)
+long long scm_page_south(long long i)
 {
-    long long l = scm_page_level(i);
-    long long a = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    return scm_page_step(i, south_edge, +1,  0);
+}
 
-    long long n = 1LL << l, m = n - 1, t = m - r;
+// Determine the page to the west of page i. -----------------------------------
+
+long long scm_page_west(long long i)
+{
+    return scm_page_step(i, west_edge,   0, -1);
+}
 
-    if      (c <  m) {        c = c + 1;    }
-    else if (a == 0) { a = 5; c = 0;        }
-    else if (a == 1) { a = 4; c = 0;        }
-    else if (a == 2) { a = 0; c = t; r = 0; }
-    else if (a == 3) { a = 0; c = r; r = m; }
-    else if (a == 4) { a = 0; c = 0;        }
-    else             { a = 1; c = 0;        }
+// Determine the page to the east of page i. -----------------------------------
 
-    return scm_page_index(a, l, r, c);
+long long scm_page_east(long long i)
+{
+    return scm_page_step(i, east_edge,   0, +1);
 }
 
 // Calculate the four corner vectors of page i. --------------------------------
 
 void scm_page_corners(long long i, double *v)
 {
-    long long l = scm_page_level(i);
-    long long a = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    long long a, l, r, c;
 
-    long long n = 1LL << l;
+    scm_page_decode(i, a, l, r, c);
 
-    scm_vector(a, (double) (r + 0) / n, (double) (c + 0) / n, v + 0);
-    scm_vector(a, (double) (r + 0) / n, (double) (c + 1) / n, v + 3);
-    scm_vector(a, (double) (r + 1) / n, (double) (c + 0) / n, v + 6);
-    scm_vector(a, (double) (r + 1) / n, (double) (c + 1) / n, v + 9);
+    double n = (double) (1LL << l);
+
+    const long long A[4] = { a, a, a, a };
+    const double    y[4] = { (r + 0) / n, (r + 0) / n, (r + 1) / n, (r + 1) / n };
+    const double    x[4] = { (c + 0) / n, (c + 1) / n, (c + 0) / n, (c + 1) / n };
+
+    scm_vector(A, y, x, v, 4);
 }
 
 // Calculate the center vector of page i. --------------------------------------
 
 void scm_page_center(long long i, double *v)
 {
-    long long l = scm_page_level(i);
-    long long a = scm_page_root(i);
-    long long r = scm_page_row(i);
-    long long c = scm_page_col(i);
+    long long a, l, r, c;
+
+    scm_page_decode(i, a, l, r, c);
 
     long long n = 1LL << l;
 
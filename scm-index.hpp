@@ -23,9 +23,22 @@
 
 // Calculate the integer binary log of n. --------------------------------------
 
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_BitScanReverse64)
+#endif
+
 static inline long long log2(long long n)
 {
-    unsigned long long v = (unsigned long long) n;
+    unsigned long long v = (unsigned long long) n | 1ULL;
+
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long r;
+    _BitScanReverse64(&r, v);
+    return (long long) r;
+#else
     unsigned long long r;
     unsigned long long s;
 
@@ -36,6 +49,7 @@ static inline long long log2(long long n)
     s = (v > 0x3ULL       ) << 1; v >>= s; r |= s;
 
     return (long long) (r | (v >> 1));
+#endif
 }
 
 // Calculate the number of pages in an SCM of depth d. -------------------------
@@ -52,34 +66,49 @@ static inline long long scm_page_level(long long i)
     return (log2(i + 2) - 1) / 2;
 }
 
+// Calculate the root, level, row, and column of page i in one pass. -----------
+
+static inline void scm_page_decode(long long i, long long& a, long long& l,
+                                                long long& r, long long& c)
+{
+    l = scm_page_level(i);
+
+    const long long j = i - 2 * ((1LL << (2 * l)) - 1);
+    const long long t = j & ((1LL << (2 * l)) - 1);
+
+    a = j >> (2 * l);
+    r = t >>      l;
+    c = t & ((1LL << l) - 1);
+}
+
 // Calculate the root page in the ancestry of page i. --------------------------
 
 static inline long long scm_page_root(long long i)
 {
-    long long n = 1LL << (2 * scm_page_level(i));
-    return (i - 2 * (n - 1)) / n;
+    long long l = scm_page_level(i);
+    return (i - 2 * ((1LL << (2 * l)) - 1)) >> (2 * l);
 }
 
 // Calculate the tile number (face index) of page i. ---------------------------
 
 static inline long long scm_page_tile(long long i)
 {
-    long long n = 1LL << (2 * scm_page_level(i));
-    return (i - 2 * (n - 1)) % n;
+    long long l = scm_page_level(i);
+    return (i - 2 * ((1LL << (2 * l)) - 1)) & ((1LL << (2 * l)) - 1);
 }
 
 // Calculate the tile row of page i. -------------------------------------------
 
 static inline long long scm_page_row(long long i)
 {
-    return scm_page_tile(i) / (1LL << scm_page_level(i));
+    return scm_page_tile(i) >> scm_page_level(i);
 }
 
 // Calculate the tile column of page i. ----------------------------------------
 
 static inline long long scm_page_col(long long i)
 {
-    return scm_page_tile(i) % (1LL << scm_page_level(i));
+    return scm_page_tile(i) & ((1LL << scm_page_level(i)) - 1);
 }
 
 // Calculate the index of the page on root a at level l, row r, column c. -----
@@ -94,26 +123,72 @@ static inline long long scm_page_index(long long a, long long l,
 
 static inline long long scm_page_parent(long long i)
 {
-    return scm_page_index(scm_page_root(i), scm_page_level(i) - 1,
-                                            scm_page_row  (i) / 2,
-                                            scm_page_col  (i) / 2);
+    long long a, l, r, c;
+
+    scm_page_decode(i, a, l, r, c);
+
+    return scm_page_index(a, l - 1, r >> 1, c >> 1);
 }
 
 // Calculate child page k of page i. -------------------------------------------
 
 static inline long long scm_page_child(long long i, long long k)
 {
-    return scm_page_index(scm_page_root(i), scm_page_level(i) + 1,
-                                            scm_page_row  (i) * 2 + k / 2,
-                                            scm_page_col  (i) * 2 + k % 2);
+    long long a, l, r, c;
+
+    scm_page_decode(i, a, l, r, c);
+
+    return scm_page_index(a, l + 1, (r << 1) | (k >> 1), (c << 1) | (k & 1));
 }
 
 // Calculate the order (child index) of page i. --------------------------------
 
 static inline long long scm_page_order(long long i)
 {
-    return 2 * (scm_page_row(i) % 2)
-             + (scm_page_col(i) % 2);
+    long long a, l, r, c;
+
+    scm_page_decode(i, a, l, r, c);
+
+    return ((r & 1) << 1) | (c & 1);
+}
+
+// Calculate the distance of row r, column c along the Hilbert curve of order l.
+
+static inline long long scm_hilbert(long long l, long long r, long long c)
+{
+    const long long n = 1LL << l;
+
+    long long d = 0;
+
+    for (long long s = n >> 1; s > 0; s >>= 1)
+    {
+        const long long x = (c & s) ? 1 : 0;
+        const long long y = (r & s) ? 1 : 0;
+
+        d += s * s * ((3 * x) ^ y);
+
+        if (y == 0)
+        {
+            if (x == 1)
+            {
+                c = n - 1 - c;
+                r = n - 1 - r;
+            }
+            const long long t = c; c = r; r = t;
+        }
+    }
+    return d;
+}
+
+// Calculate the position of page i along the Hilbert curve of its root face. -
+
+static inline long long scm_page_curve(long long i)
+{
+    long long a, l, r, c;
+
+    scm_page_decode(i, a, l, r, c);
+
+    return scm_hilbert(l, r, c);
 }
 
 //------------------------------------------------------------------------------
@@ -121,6 +196,10 @@ static inline long long scm_page_order(long long i)
 void scm_locate(long long *, double *, double *, const double *);
 void scm_vector(long long,   double,   double,         double *);
 
+void scm_locate(long long *, double *, double *, const double *, int);
+void scm_vector(const long long *, const double *,
+                const double *,          double *, int);
+
 long long scm_page_north(long long);
 long long scm_page_south(long long);
 long long scm_page_west (long long);
@@ -0,0 +1,299 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <zlib.h>
+
+#include "scm-pack.hpp"
+#include "scm-log.hpp"
+
+//------------------------------------------------------------------------------
+
+static const char magic[8] = "SCMPACK";
+
+// Map the named file read-only. Give its size in s and a handle in h needed to
+// unmap it. Return null on failure.
+
+static const uint8 *map(const char *name, uint64& s, void *& h)
+{
+#ifdef _WIN32
+    HANDLE f = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    HANDLE m = NULL;
+    void  *p = NULL;
+
+    if (f != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER l;
+
+        if (GetFileSizeEx(f, &l) && l.QuadPart > 0)
+        {
+            if ((m = CreateFileMapping(f, NULL, PAGE_READONLY, 0, 0, NULL)))
+            {
+                if ((p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0)))
+                {
+                    s = uint64(l.QuadPart);
+                    h = m;
+                }
+                else CloseHandle(m);
+            }
+        }
+        CloseHandle(f);
+    }
+    return (const uint8 *) p;
+#else
+    struct stat st;
+    void       *p = 0;
+    int         f;
+
+    if ((f = open(name, O_RDONLY)) != -1)
+    {
+        if (fstat(f, &st) == 0 && st.st_size > 0)
+        {
+            if ((p = mmap(0, size_t(st.st_size), PROT_READ, MAP_SHARED, f, 0))
+                                                               != MAP_FAILED)
+            {
+                s = uint64(st.st_size);
+                h = 0;
+            }
+            else p = 0;
+        }
+        close(f);
+    }
+    return (const uint8 *) p;
+#endif
+}
+
+// Unmap a file mapped by map.
+
+static void unmap(const uint8 *p, uint64 s, void *h)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(p);
+    CloseHandle((HANDLE) h);
+#else
+    (void) h;
+    munmap((void *) p, size_t(s));
+#endif
+}
+
+// Apply (d > 0) or remove (d < 0) horizontal differencing of the integer
+// samples of the given w-by-h page of c channels of b bits.
+
+template <typename T> static void difference(int w, int h, int c, T *p, int d)
+{
+    for (int i = 0; i < h; ++i)
+    {
+        T *r = p + size_t(i) * w * c;
+
+        if (d > 0)
+            for (int j = (w - 1) * c - 1; j >= 0; --j)
+                r[j + c] = T(r[j + c] - r[j]);
+        else
+            for (int j = 0; j < (w - 1) * c; ++j)
+                r[j + c] = T(r[j + c] + r[j]);
+    }
+}
+
+static void difference(int w, int h, int c, int b, void *p, int d)
+{
+    switch (b)
+    {
+    case  8: difference(w, h, c, (uint8  *) p, d); break;
+    case 16: difference(w, h, c, (uint16 *) p, d); break;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+/// Map an SCM pack file and validate its header and page table. On failure
+/// the pack is left invalid. @see is_valid
+///
+/// @param path Fully resolved path and name of the pack file
+
+scm_pack::scm_pack(const std::string& path) :
+    data(0), size(0), hand(0), head(0),
+    xv(0), ov(0), sv(0), av(0), zv(0), cv(0)
+{
+    if ((data = map(path.c_str(), size, hand)))
+    {
+        const scm_pack_header *H = (const scm_pack_header *) data;
+
+        if (size >= sizeof (scm_pack_header)
+            && memcmp(H->magic, magic, sizeof (magic)) == 0 && H->version == 1)
+        {
+            const uint64 e = uint64(H->c) * H->b / 8;
+            const uint64 n = H->n;
+
+            // Confirm that the table lies within the file.
+
+            if (H->t % 8 == 0 && H->t <= size
+                              && n <= (size - H->t) / (3 * 8 + 2 * e + 1))
+            {
+                xv = (const uint64 *) (data + H->t);
+                ov = xv + n;
+                sv = ov + n;
+                av = sv + n;
+                zv = (const uint8 *) av + n * e;
+                cv = (const uint8 *) zv + n * e;
+
+                // Index the pages by offset, for loading by offset.
+
+                order.reserve(size_t(n));
+
+                for (uint64 k = 0; k < n; ++k)
+                    if (ov[k])
+                        order.push_back(std::make_pair(ov[k], k));
+
+                std::sort(order.begin(), order.end());
+
+                head = H;
+            }
+        }
+        if (head == 0)
+            scm_log("scm_pack invalid %s", path.c_str());
+    }
+    scm_log("scm_pack constructor %s", path.c_str());
+}
+
+/// Unmap the pack file.
+
+scm_pack::~scm_pack()
+{
+    if (data) unmap(data, size, hand);
+
+    scm_log("scm_pack destructor");
+}
+
+/// Return true if the named file is an SCM pack, as determined by its magic
+/// number.
+///
+/// @param path Fully resolved path and name of the file
+
+bool scm_pack::test(const std::string& path)
+{
+    char m[sizeof (magic)];
+    bool b = false;
+
+    if (FILE *f = fopen(path.c_str(), "rb"))
+    {
+        if (fread(m, 1, sizeof (m), f) == sizeof (m))
+            b = (memcmp(m, magic, sizeof (magic)) == 0);
+        fclose(f);
+    }
+    return b;
+}
+
+/// Load the page with payload offset o into buffer p, which must be large
+/// enough to receive a full page. Return false if there is no such page or if
+/// its payload is corrupt. This may be called by any number of threads.
+///
+/// @param o Page payload offset
+/// @param p Destination pixel buffer
+
+bool scm_pack::load(uint64 o, void *p) const
+{
+    if (head)
+    {
+        std::vector<std::pair<uint64, uint64> >::const_iterator i;
+
+        i = std::lower_bound(order.begin(), order.end(),
+                             std::make_pair(o, uint64(0)));
+
+        if (i != order.end() && i->first == o)
+        {
+            const uint64 k = i->second;
+            const uint64 m = uint64(head->w) * head->h * head->c * head->b / 8;
+
+            if (o <= size && sv[k] <= size - o)
+            {
+                switch (cv[k])
+                {
+                case scm_pack_raw:
+
+                    if (sv[k] == m)
+                    {
+                        memcpy(p, data + o, size_t(m));
+                        return true;
+                    }
+                    break;
+
+                case scm_pack_deflate:
+                {
+                    uLongf d = uLongf(m);
+                    uLong  s = uLong (sv[k]);
+
+                    if (uncompress((Bytef *) p, &d, data + o, s) == Z_OK && d == m)
+                    {
+                        difference(int(head->w), int(head->h),
+                                   int(head->c), int(head->b), p, -1);
+                        return true;
+                    }
+                    break;
+                }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/// Encode a page for storage in an SCM pack. If z is set, attempt to deflate
+/// it, and if this helps then give the result in d and return the deflate
+/// codec. Otherwise, give the page as-is and return the raw codec.
+///
+/// @param w Page width
+/// @param h Page height
+/// @param c Page channels per pixel
+/// @param b Page bits per channel
+/// @param p Page pixel buffer
+/// @param z Deflate flag
+/// @param d Encoded page output
+
+int scm_pack_page(int w, int h, int c, int b, const void *p, bool z,
+                  std::vector<uint8>& d)
+{
+    const size_t m = size_t(w) * size_t(h) * size_t(c) * size_t(b) / 8;
+
+    if (z)
+    {
+        std::vector<uint8> t((const uint8 *) p, (const uint8 *) p + m);
+
+        difference(w, h, c, b, &t.front(), +1);
+
+        uLongf n = compressBound(uLong(m));
+
+        d.resize(n);
+
+        if (compress2(&d.front(), &n, &t.front(), uLong(m), 6) == Z_OK && n < m)
+        {
+            d.resize(n);
+            return scm_pack_deflate;
+        }
+    }
+    d.assign((const uint8 *) p, (const uint8 *) p + m);
+    return scm_pack_raw;
+}
+
+//------------------------------------------------------------------------------
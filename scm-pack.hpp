@@ -0,0 +1,117 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef SCM_PACK_HPP
+#define SCM_PACK_HPP
+
+#include <string>
+#include <vector>
+
+#include <tiffio.h>
+
+//------------------------------------------------------------------------------
+
+/// An scm_pack_header begins an SCM pack file
+///
+/// An SCM pack is an alternative to the SCM TIFF designed to be memory-mapped.
+/// The header is followed by page payloads, each beginning on a multiple of
+/// scm_pack_align bytes, followed by the page table at offset t, which is also
+/// aligned. The table gives n sorted page indices, n payload offsets, and n
+/// payload sizes, all 64-bit, then n per-channel minima and n per-channel
+/// maxima of the page sample type, and finally n one-byte codec tags. All
+/// values are little-endian. The header and table are used in place, without
+/// byte swapping, so packs are supported on little-endian hosts only. On a
+/// big-endian host the header version does not match and the pack is refused.
+
+struct scm_pack_header
+{
+    char   magic[8];    ///< "SCMPACK" with terminating zero
+    uint32 version;     ///< Format version
+    uint32 w;           ///< Page width
+    uint32 h;           ///< Page height
+    uint16 c;           ///< Sample count
+    uint16 b;           ///< Sample depth
+    uint64 n;           ///< Page count
+    uint64 t;           ///< Page table offset
+};
+
+/// Payload alignment of an SCM pack.
+
+const uint64 scm_pack_align = 4096;
+
+/// Payload codecs of an SCM pack.
+
+enum
+{
+    scm_pack_raw     = 0,  ///< Uncompressed samples
+    scm_pack_deflate = 1   ///< Samples compressed as a single zlib stream,
+                           ///< with horizontal differencing of integer samples
+};
+
+//------------------------------------------------------------------------------
+
+/// An scm_pack is a read-only, memory-mapped SCM pack file
+///
+/// The page table is referenced in place, and pages are loaded directly from
+/// the mapping. A pack carries no per-handle state, so any number of threads
+/// may load pages from one pack concurrently.
+
+class scm_pack
+{
+public:
+
+    scm_pack(const std::string&);
+   ~scm_pack();
+
+    static bool test(const std::string&);
+
+    bool is_valid() const { return head != 0; }
+
+    uint32        get_w() const { return head->w; }
+    uint32        get_h() const { return head->h; }
+    uint16        get_c() const { return head->c; }
+    uint16        get_b() const { return head->b; }
+    uint64        get_n() const { return head->n; }
+
+    const uint64 *get_x() const { return xv; }
+    const uint64 *get_o() const { return ov; }
+    const uint64 *get_s() const { return sv; }
+    const void   *get_a() const { return av; }
+    const void   *get_z() const { return zv; }
+
+    bool load(uint64, void *) const;
+
+private:
+
+    const uint8           *data;  // Mapped file
+    uint64                 size;  // Mapped file size
+    void                  *hand;  // Platform mapping handle
+
+    const scm_pack_header *head;  // File header
+    const uint64          *xv;    // Page indices
+    const uint64          *ov;    // Page payload offsets
+    const uint64          *sv;    // Page payload sizes
+    const void            *av;    // Page minima
+    const void            *zv;    // Page maxima
+    const uint8           *cv;    // Page codecs
+
+    std::vector<std::pair<uint64, uint64> > order;  // Pages by offset
+};
+
+//------------------------------------------------------------------------------
+/// @file
+
+int scm_pack_page(int, int, int, int, const void *, bool, std::vector<uint8>&);
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -43,6 +43,8 @@ public:
     bool try_insert(T&);
     bool try_remove(T&);
 
+    template <typename F> bool try_update(const T&, F);
+
     void insert(T);
     T    remove( );
 
@@ -113,6 +115,31 @@ template <typename T> bool scm_queue<T>::try_remove(T& d)
     return false;
 }
 
+/// Non-blocking modification for use by the render thread. If an entry equal
+/// to d is queued, apply f to it and requeue it in its new order. Return true
+/// if the entry was found.
+
+template <typename T> template <typename F> bool scm_queue<T>::try_update(const T& d, F f)
+{
+    bool b = false;
+
+    SDL_LockMutex(data_mutex);
+    {
+        typename std::set<T>::iterator i = S.find(d);
+
+        if (i != S.end())
+        {
+            T e = *i;
+            S.erase(i);
+            f(e);
+            S.insert(e);
+            b = true;
+        }
+    }
+    SDL_UnlockMutex(data_mutex);
+    return b;
+}
+
 //------------------------------------------------------------------------------
 
 /// Blocking enqueue for use by the loader threads.
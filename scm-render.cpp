@@ -13,6 +13,7 @@
 #include <cstdlib>
 #include <cmath>
 #include <cstring>
+#include <map>
 
 #include "util3d/math3d.h"
 
@@ -25,6 +26,7 @@
 //------------------------------------------------------------------------------
 
 static void fillscreen(int, int);
+static void back_matrix(double *, double *, const double *, const double *);
 
 static void wire_on();
 static void wire_off();
@@ -88,6 +90,106 @@ void scm_render::set_wire(bool w)
 
 //------------------------------------------------------------------------------
 
+/// Prepare the foreground and background spheres for rendering in several
+/// channels at once, such as the eyes of a stereo pair or the faces of a cube
+/// map. Each scene receives a single shared visibility and subdivision pass
+/// covering all of the views in which it appears. Subsequent render calls with
+/// matching matrices during the same frame reuse these results.
+///
+/// @see scm_sphere::prep
+///
+/// @param sphere  Sphere geometry manager to perform the rendering
+/// @param fore0   Foreground scene at the beginning of a dissolve
+/// @param fore1   Foreground scene at the end of a dissolve
+/// @param back0   Background scene at the beginning of a dissolve
+/// @param back1   Background scene at the end of a dissolve
+/// @param P       Array of n projection matrices in OpenGL column-major order
+/// @param M       Array of n model-view matrices in OpenGL column-major order
+/// @param channel Array of n channel indices
+/// @param n       Number of views
+/// @param frame   Frame number
+/// @param t       Dissolve time between 0 and 1
+
+void scm_render::prep(scm_sphere *sphere,
+                      scm_scene  *fore0,
+                      scm_scene  *fore1,
+                      scm_scene  *back0,
+                      scm_scene  *back1,
+                    const double *P,
+                    const double *M, const int *channel, int n,
+                                 int frame, double t)
+{
+    const bool do_fade = check_fade(fore0, fore1, back0, back1, t);
+
+    std::map<scm_scene *, scm_view_v> views;
+
+    for (int i = 0; i < n; ++i)
+    {
+        scm_view f;
+        scm_view b;
+        double   Q[16];
+        double   N[16];
+
+        f.width  = b.width   = width;
+        f.height = b.height  = height;
+        f.channel = b.channel = channel[i];
+
+        mmultiply(f.M, P + 16 * i, M + 16 * i);
+        back_matrix(Q, N,  P + 16 * i, M + 16 * i);
+        mmultiply(b.M, Q, N);
+
+        if (fore0) views[fore0].push_back(f);
+        if (back0) views[back0].push_back(b);
+
+        if (do_fade && fore1 && fore1 != fore0) views[fore1].push_back(f);
+        if (do_fade && back1 && back1 != back0) views[back1].push_back(b);
+    }
+
+    std::map<scm_scene *, scm_view_v>::iterator i;
+
+    for (i = views.begin(); i != views.end(); ++i)
+        sphere->prep(i->first, &i->second.front(), int(i->second.size()), frame);
+}
+
+/// Prefetch the pages of the foreground and background spheres as they would
+/// appear in an anticipated view. @see scm_sphere::prefetch
+///
+/// @param sphere  Sphere geometry manager to perform the rendering
+/// @param fore0   Foreground scene at the beginning of a dissolve
+/// @param fore1   Foreground scene at the end of a dissolve
+/// @param back0   Background scene at the beginning of a dissolve
+/// @param back1   Background scene at the end of a dissolve
+/// @param P       Anticipated projection matrix in OpenGL column-major order
+/// @param M       Anticipated model-view matrix in OpenGL column-major order
+/// @param channel Channel index
+/// @param frame   Frame number
+/// @param t       Dissolve time between 0 and 1
+
+void scm_render::prefetch(scm_sphere *sphere,
+                          scm_scene  *fore0,
+                          scm_scene  *fore1,
+                          scm_scene  *back0,
+                          scm_scene  *back1,
+                        const double *P,
+                        const double *M, int channel, int frame, double t)
+{
+    const bool do_fade = check_fade(fore0, fore1, back0, back1, t);
+
+    double F[16], B[16], Q[16], N[16];
+
+    mmultiply(F, P, M);
+    back_matrix(Q, N, P, M);
+    mmultiply(B, Q, N);
+
+    if (fore0) sphere->prefetch(fore0, F, width, height, channel, frame);
+    if (back0) sphere->prefetch(back0, B, width, height, channel, frame);
+
+    if (do_fade && fore1 && fore1 != fore0)
+        sphere->prefetch(fore1, F, width, height, channel, frame);
+    if (do_fade && back1 && back1 != back0)
+        sphere->prefetch(back1, B, width, height, channel, frame);
+}
+
 /// Render the foreground and background with optional blur and dissolve.
 ///
 /// @param sphere  Sphere geometry manager to perform the rendering
@@ -238,26 +340,9 @@ void scm_render::render(scm_sphere *sphere,
 
     if (back)
     {
-        // Extract only the rotation of the view matrix.
+        double N[16], Q[16], T[16];
 
-        double N[16], Q[16], T[16], I[16];
-
-        midentity(N);
-        vnormalize(N + 0, M + 0);
-        vnormalize(N + 4, M + 4);
-        vnormalize(N + 8, M + 8);
-
-        // Remove any offset in the projection matrix.
-
-        double w[4], v[4] = { 0.0, 0.0, -1.0, 0.0 };
-
-        minvert(I, P);
-        wtransform(w, I, v);
-        w[0] /= w[3];
-        w[1] /= w[3];
-        w[2] /= w[3];
-        mtranslate(T, w);
-        mmultiply(Q, P, T);
+        back_matrix(Q, N, P, M);
 
         // Apply the transform.
 
@@ -582,6 +667,33 @@ void scm_render::check_atmo(const double *P,
 
 //------------------------------------------------------------------------------
 
+/// Compute the background projection Q and model-view N from the projection P
+/// and model-view M, removing any translation.
+
+static void back_matrix(double *Q, double *N, const double *P, const double *M)
+{
+    // Extract only the rotation of the view matrix.
+
+    double T[16], I[16];
+
+    midentity(N);
+    vnormalize(N + 0, M + 0);
+    vnormalize(N + 4, M + 4);
+    vnormalize(N + 8, M + 8);
+
+    // Remove any offset in the projection matrix.
+
+    double w[4], v[4] = { 0.0, 0.0, -1.0, 0.0 };
+
+    minvert(I, P);
+    wtransform(w, I, v);
+    w[0] /= w[3];
+    w[1] /= w[3];
+    w[2] /= w[3];
+    mtranslate(T, w);
+    mmultiply(Q, P, T);
+}
+
 /// Draw a screen-filling rectangle.
 
 static void fillscreen(int w, int h)
@@ -50,6 +50,20 @@ public:
     int  get_blur() const { return blur; }
     bool get_wire() const { return wire; }
 
+    void prep  (scm_sphere *,
+                scm_scene  *,
+                scm_scene  *,
+                scm_scene  *,
+                scm_scene  *,
+              const double *,
+              const double *, const int *, int, int, double);
+    void prefetch(scm_sphere *,
+                scm_scene  *,
+                scm_scene  *,
+                scm_scene  *,
+                scm_scene  *,
+              const double *,
+              const double *, int, int, double);
     void render(scm_sphere *,
                 scm_scene  *,
                 scm_scene  *,
@@ -12,6 +12,11 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <SDL.h>
+#include <SDL_thread.h>
 
 #include "util3d/math3d.h"
 
@@ -22,12 +27,52 @@
 
 //------------------------------------------------------------------------------
 
+// An scm_batch gives one thread's share of a large batch sample: a range of
+// located vectors sorted by page, and the output array.
+
+struct scm_batch
+{
+    scm_sample       *sample;
+    const scm_point  *p;
+    int               n;
+    float            *k;
+};
+
+//------------------------------------------------------------------------------
+
+/// The maximum number of threads sampling a single large batch.
+
+int scm_sample::batch_threads = 4;
+
+/// The minimum number of vectors in a batch per thread. Smaller batches are
+/// sampled by the calling thread.
+
+int scm_sample::batch_size    = 1024;
+
+/// The maximum size in bytes of decoded pages retained by each sampler. Set 0
+/// to retain none.
+
+int scm_sample::cache_bytes   = 64 * 1024 * 1024;
+
+//------------------------------------------------------------------------------
+
 /// Create a new SCM TIFF file sampler
 ///
 /// The given scm_file object includes the path and parameters of the TIFF
-/// file. Open that TIFF and prepare to make cached access to it.
-
-scm_sample::scm_sample(scm_file *file) : file(file)
+/// file. Open that TIFF and prepare to make cached access to it. If the file
+/// is an SCM pack then no TIFF is needed.
+
+scm_sample::scm_sample(scm_file *file) :
+    file(file),
+    mutex(SDL_CreateMutex()),
+    thread(0),
+    running(false),
+    queries(64),
+    results(64),
+    spare_mutex(SDL_CreateMutex()),
+    spare_serial(0),
+    cache_mutex(SDL_CreateMutex()),
+    bytes(0)
 {
     last_v[0] = 0;
     last_v[1] = 0;
@@ -38,15 +83,12 @@ scm_sample::scm_sample(scm_file *file) : file(file)
     last_i0   = (tsize_t) (-1);
     last_i1   = (tsize_t) (-1);
 
-    if ((tiff = TIFFOpen(file->get_path(), "r")))
-    {
-        tsize_t N = TIFFNumberOfStrips(tiff);
-        tsize_t S = TIFFStripSize     (tiff);
+    if (file->get_pack())
+        tiff = 0;
+    else
+        tiff = TIFFOpen(file->get_path(), "r");
 
-        last_p = (uint8 *) malloc(S * N);
-
-        scm_log("scm_sample constructor %s", file->get_path());
-    }
+    scm_log("scm_sample constructor %s", file->get_path());
 }
 
 // Release the TIFF
@@ -55,127 +97,623 @@ scm_sample::~scm_sample()
 {
     scm_log("scm_sample destructor");
 
+    // Signal the sampler thread to exit, draining results to ensure it is not
+    // blocked, and await its exit.
+
+    if (thread)
+    {
+        scm_query stop;
+        scm_query junk;
+        int       s;
+
+        while (!queries.try_insert(stop))
+        {
+            while (results.try_remove(junk)) { }
+            SDL_Delay(1);
+        }
+        while (running.get())
+        {
+            while (results.try_remove(junk)) { }
+            SDL_Delay(1);
+        }
+        SDL_WaitThread(thread, &s);
+    }
+
+    // Release all decoded pages.
+
+    for (page_m::iterator i = pages.begin(); i != pages.end(); ++i)
+        free(i->second.p);
+
     free(last_p);
 
+    // Release all batch TIFF handles.
+
+    for (size_t j = 0; j < spare.size(); ++j)
+        TIFFClose(spare[j]);
+
+    SDL_DestroyMutex(spare_mutex);
+    SDL_DestroyMutex(cache_mutex);
+    SDL_DestroyMutex(mutex);
+
     if (tiff) TIFFClose(tiff);
 }
 
 //------------------------------------------------------------------------------
 
-/// Decode the raw data in the current page cache, returning a pixel value.
+/// Decode the raw data in the given page buffer, returning a pixel value.
 ///
+/// @param p page buffer
 /// @param y pixel row
 /// @param x pixel column
 
-float scm_sample::lookup(int y, int x) const
+float scm_sample::lookup(const uint8 *p, int y, int x) const
 {
     int w = file->get_w();
     int c = file->get_c();
 
     switch (file->get_b())
     {
-        case  8: return ((unsigned char  *) last_p)[(w * y + x) * c] /   255.f;
-        case 16: return ((unsigned short *) last_p)[(w * y + x) * c] / 65535.f;
-        case 32: return ((         float *) last_p)[(w * y + x) * c];
+        case  8: return ((unsigned char  *) p)[(w * y + x) * c] /   255.f;
+        case 16: return ((unsigned short *) p)[(w * y + x) * c] / 65535.f;
+        case 32: return ((         float *) p)[(w * y + x) * c];
         default: return 1.f;
     }
 }
 
+/// Sample the given page buffer with linear filtering at the given local page
+/// coordinate.
+///
+/// @param p page buffer
+/// @param y page row coordinate in [0, 1]
+/// @param x page column coordinate in [0, 1]
+
+float scm_sample::filter(const uint8 *p, double y, double x) const
+{
+    double r = y * (file->get_h() - 2.0) + 0.5;
+    double c = x * (file->get_w() - 2.0) + 0.5;
+
+    int r0 = int(floor(r)), r1 = r0 + 1;
+    int c0 = int(floor(c)), c1 = c0 + 1;
+
+    float s00 = lookup(p, r0, c0);
+    float s01 = lookup(p, r0, c1);
+    float s10 = lookup(p, r1, c0);
+    float s11 = lookup(p, r1, c1);
+
+    double rr = r - floor(r);
+    double cc = c - floor(c);
+
+    return float(lerp(lerp(s00, s01, cc),
+                      lerp(s10, s11, cc), rr));
+}
+
 /// Perform a sample along a vector
 ///
-/// Seek the deepest page that contains the given vector and return a linearly-
-/// filtered sample of it. In the interest of performance, cache the page and
-/// cache the most recent result. In the interest of minimizing latency, read
-/// only a single scanline at a time.
+/// This blocks if the sampler thread is busy with an asynchronous query.
 ///
 /// @param v Vector from the center of the sphere to the sample point
 
 float scm_sample::get(const double *v)
 {
-    if (file && tiff)
+    float k;
+
+    SDL_LockMutex(mutex);
+    k = sample(v);
+    SDL_UnlockMutex(mutex);
+
+    return k;
+}
+
+/// Perform samples along many vectors
+///
+/// Locate each vector within the deepest page containing it and sort them by
+/// page. Read each page at most once and sample all of its vectors. Divide
+/// large batches among several threads, each with a pooled TIFF handle. Vectors
+/// that cannot be sampled give 1.
+///
+/// @param v Array of n vectors from the center of the sphere
+/// @param k Array of n sample outputs
+/// @param n Number of vectors
+
+void scm_sample::get(const double *v, float *k, int n)
+{
+    std::fill(k, k + n, 1.f);
+
+    if (ready() && n > 0)
+    {
+        std::vector<scm_point> P(n);
+        std::vector<long long> A(n);
+        std::vector<double>    Y(n);
+        std::vector<double>    X(n);
+
+        // Locate each vector within the deepest page containing it.
+
+        scm_locate(&A.front(), &Y.front(), &X.front(), v, n);
+
+        for (int i = 0; i < n; ++i)
+        {
+            P[i].y = Y[i];
+            P[i].x = 1 - X[i];
+            P[i].o = file->find_page(A[i], P[i].y, P[i].x);
+            P[i].i = i;
+        }
+
+        std::sort(P.begin(), P.end());
+
+        int t = std::min(batch_threads, n / std::max(batch_size, 1));
+
+        if (t > 1)
+        {
+            int batcher(void *);
+
+            std::vector<scm_batch>    B(t);
+            std::vector<SDL_Thread *> T(t);
+
+            // Divide the vectors among threads at page boundaries.
+
+            for (int j = 0, i0 = 0; j < t; ++j)
+            {
+                int i1 = std::max(i0, (j == t - 1) ? n : n * (j + 1) / t);
+
+                while (0 < i1 && i1 < n && P[i1].o == P[i1 - 1].o)
+                    i1++;
+
+                B[j].sample = this;
+                B[j].p      = &P[0] + i0;
+                B[j].n      = i1 - i0;
+                B[j].k      = k;
+
+                if ((T[j] = SDL_CreateThread(batcher, "scm-batcher", &B[j])) == 0)
+                    batcher(&B[j]);
+
+                i0 = i1;
+            }
+
+            for (int j = 0, s; j < t; ++j)
+                if (T[j]) SDL_WaitThread(T[j], &s);
+        }
+        else
+        {
+            SDL_LockMutex(mutex);
+            batch(tiff, &P[0], n, k);
+            SDL_UnlockMutex(mutex);
+        }
+    }
+}
+
+/// Request a sample along a vector asynchronously
+///
+/// Queue the query for the sampler thread, launching it if necessary, and
+/// return an immediate estimate of the result. The query result may later be
+/// retrieved using pop. Set flag b to indicate whether the query was queued.
+/// If the queue is full, the estimate is all there is.
+///
+/// @param i Query identifier
+/// @param v Vector from the center of the sphere to the sample point
+/// @param b Query queued flag output
+
+float scm_sample::put(int i, const double *v, bool& b)
+{
+    if (ready())
+    {
+        if (thread == 0)
+        {
+            int sampler(void *);
+
+            running.set(true);
+
+            if ((thread = SDL_CreateThread(sampler, "scm-sampler", this)) == 0)
+                running.set(false);
+        }
+        if (thread)
+        {
+            scm_query query(i, v);
+
+            b = queries.try_insert(query);
+        }
+        else b = false;
+    }
+    else b = false;
+
+    return guess(v);
+}
+
+/// Retrieve the result of an asynchronous query without blocking. Return
+/// false if no result is ready.
+
+bool scm_sample::pop(scm_query& query)
+{
+    return results.try_remove(query);
+}
+
+/// Reopen the TIFF after its catalog has been reloaded, so that pages appended
+/// since it was opened may be read. Batch handles are closed and are opened
+/// anew on demand. Decoded pages are keyed by file offset, and replaced pages
+/// have new offsets, so the decoded page cache remains valid.
+
+void scm_sample::reopen()
+{
+    SDL_LockMutex(spare_mutex);
+    {
+        for (size_t j = 0; j < spare.size(); ++j)
+            TIFFClose(spare[j]);
+
+        spare.clear();
+        spare_serial++;
+    }
+    SDL_UnlockMutex(spare_mutex);
+
+    SDL_LockMutex(mutex);
+    {
+        if (tiff) TIFFClose(tiff);
+
+        tiff = file->get_pack() ? 0 : TIFFOpen(file->get_path(), "r");
+
+        last_v[0] = 0;
+        last_v[1] = 0;
+        last_v[2] = 0;
+        last_k    = 0;
+        last_o    = 0;
+        last_i0   = (tsize_t) (-1);
+        last_i1   = (tsize_t) (-1);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+// Estimate the sample along vector v without touching the file. If v is the
+// vector of the most recent sample, and the sampler is not busy, return that
+// result. If the deepest page containing v is decoded, sample it. Otherwise,
+// return the maximum of that page as given by the page catalog, which errs on
+// the side of safety when used for collision detection.
+
+float scm_sample::guess(const double *v)
+{
+    if (SDL_TryLockMutex(mutex) == 0)
+    {
+        bool  b = (v[0] == last_v[0] && v[1] == last_v[1] && v[2] == last_v[2]);
+        float k = last_k;
+
+        SDL_UnlockMutex(mutex);
+
+        if (b) return k;
+    }
+
+    scm_point p;
+    long long a;
+    float     k;
+
+    scm_locate(&a, &p.y, &p.x, v);
+
+    p.x = 1 - p.x;
+    p.o = file->find_page(a, p.y, p.x);
+    p.i = 0;
+
+    if (find(&p, 1, &k))
+        return k;
+    else
+        return file->get_page_guess(v);
+}
+
+// Seek the deepest page that contains the given vector and return a linearly-
+// filtered sample of it. In the interest of performance, retain the decoded
+// page and cache the most recent result. If decoded pages are not retained,
+// read only the strips needed, as a whole page would be decoded only to be
+// discarded. The caller must hold the mutex.
+
+float scm_sample::sample(const double *v)
+{
+    if (ready())
     {
         if (v[0] != last_v[0] || v[1] != last_v[1] || v[2] != last_v[2])
         {
             // Locate the face and coordinates of vector v.
 
+            scm_point p;
             long long a;
-            double    y;
-            double    x;
 
-            scm_locate(&a, &y, &x, v);
-            x = 1 - x;
+            scm_locate(&a, &p.y, &p.x, v);
+            p.x = 1 - p.x;
+
+            // Find the deepest page covering this location and sample it.
+
+            p.o = file->find_page(a, p.y, p.x);
+            p.i = 0;
+
+            bool b;
 
-            // Find the deepest page covering this location.
+            if (cache_bytes > 0 || !tiff)
+                b = batch(tiff, &p, 1, &last_k);
+            else
+                b = strip(p, last_k);
 
-            uint64 o = file->find_page(a, y, x);
+            // Cache the request only if a sample was produced.
 
-            // Convert the root face coordinate to a local face coordinate.
+            if (b)
+            {
+                last_v[0] = v[0];
+                last_v[1] = v[1];
+                last_v[2] = v[2];
+            }
+        }
+    }
+    return last_k;
+}
 
-            double r = y * (file->get_h() - 2.0) + 0.5;
-            double c = x * (file->get_w() - 2.0) + 0.5;
+// Sample n located vectors, sorted by page, using the given TIFF. Sample each
+// page from the decoded page cache if possible, or read and retain it if not.
+// Return false if any page could not be read, leaving its outputs unchanged.
 
-            int r0 = int(floor(r)), r1 = r0 + 1;
-            int c0 = int(floor(c)), c1 = c0 + 1;
+bool scm_sample::batch(TIFF *T, const scm_point *p, int n, float *k)
+{
+    bool ok = true;
 
-            tsize_t i0 = TIFFComputeStrip(tiff, r0, 0);
-            tsize_t i1 = TIFFComputeStrip(tiff, r1, 0);
+    for (int i = 0, j; i < n; i = j)
+    {
+        // Find the range of vectors falling on this page.
 
-            // If the required page is not current, set it.
+        for (j = i + 1; j < n && p[j].o == p[i].o; ++j)
+            ;
 
-            if (last_o != o)
+        if (!find(p + i, j - i, k))
+        {
+            if (uint8 *b = read(T, p[i].o))
             {
-                if (TIFFSetSubDirectory(tiff, o))
-                {
-                    last_i0 = (tsize_t) -1;
-                    last_i1 = (tsize_t) -1;
-                    last_o  = o;
-                }
+                for (int m = i; m < j; ++m)
+                    k[p[m].i] = filter(b, p[m].y, p[m].x);
+
+                keep(p[i].o, b);
             }
+            else ok = false;
+        }
+    }
+    return ok;
+}
+
+// Sample the page of located vector p, reading only the strips containing the
+// rows of its filter footprint. Retain the strips of the most recent sample in
+// a page-sized buffer, so that nearby samples need not touch the file. Return
+// false and leave k unchanged on failure. The caller must hold the mutex.
+
+bool scm_sample::strip(const scm_point& p, float& k)
+{
+    // If the required page is not current, set it.
+
+    if (last_o != p.o || last_o == 0)
+    {
+        last_i0 = (tsize_t) (-1);
+        last_i1 = (tsize_t) (-1);
+        last_o  = 0;
+
+        if (TIFFSetSubDirectory(tiff, p.o))
+        {
+            if (last_p == 0)
+                last_p = (uint8 *) malloc(TIFFStripSize     (tiff) *
+                                          TIFFNumberOfStrips(tiff));
+            last_o = p.o;
+        }
+        else return false;
+    }
+
+    if (last_p)
+    {
+        double r = p.y * (file->get_h() - 2.0) + 0.5;
+
+        int r0 = int(floor(r)), r1 = r0 + 1;
+
+        tsize_t i0 = TIFFComputeStrip(tiff, r0, 0);
+        tsize_t i1 = TIFFComputeStrip(tiff, r1, 0);
+
+        // If the required strips are not cached, load them.
+
+        if (last_i0 != i0 || last_i1 != i1)
+        {
+            tsize_t S = TIFFStripSize(tiff);
+
+            if (TIFFReadEncodedStrip(tiff, i0, last_p + i0 * S, S) < 0)
+                return false;
+            if (i1 != i0 &&
+                TIFFReadEncodedStrip(tiff, i1, last_p + i1 * S, S) < 0)
+                return false;
+
+            last_i0 = i0;
+            last_i1 = i1;
+        }
+        k = filter(last_p, p.y, p.x);
+        return true;
+    }
+    return false;
+}
+
+// Take a batch TIFF handle from the pool, opening one if none is spare. Give
+// its generation in n. Return null on failure.
+
+TIFF *scm_sample::acquire(int& n)
+{
+    TIFF *T = 0;
+
+    SDL_LockMutex(spare_mutex);
+    {
+        n = spare_serial;
+
+        if (!spare.empty())
+        {
+            T = spare.back();
+            spare.pop_back();
+        }
+    }
+    SDL_UnlockMutex(spare_mutex);
+
+    if (T == 0)
+        T = TIFFOpen(file->get_path(), "r");
+
+    return T;
+}
+
+// Return batch TIFF handle T of generation n to the pool, or close it if the
+// file has been reopened since it was taken.
+
+void scm_sample::release(TIFF *T, int n)
+{
+    SDL_LockMutex(spare_mutex);
+    {
+        if (n == spare_serial)
+        {
+            spare.push_back(T);
+            T = 0;
+        }
+    }
+    SDL_UnlockMutex(spare_mutex);
+
+    if (T) TIFFClose(T);
+}
+
+// Return true if this sampler has a source of page data.
+
+bool scm_sample::ready() const
+{
+    return file && (tiff || file->get_pack());
+}
+
+// Read and decode the page at offset o using the given TIFF, or the SCM pack
+// if the file is one. Return a newly-allocated buffer, or null on failure.
+
+uint8 *scm_sample::read(TIFF *T, uint64 o) const
+{
+    if (const scm_pack *P = file->get_pack())
+    {
+        const size_t s = size_t(file->get_w()) * size_t(file->get_h())
+                       * size_t(file->get_c()) * size_t(file->get_b() / 8);
+
+        if (uint8 *b = (uint8 *) malloc(s))
+        {
+            if (P->load(o, b))
+                return b;
 
-            // If the required data is not cached, load it.
+            free(b);
+        }
+        return 0;
+    }
+    if (T && TIFFSetSubDirectory(T, o))
+    {
+        tsize_t N = TIFFNumberOfStrips(T);
+        tsize_t S = TIFFStripSize     (T);
+
+        if (uint8 *b = (uint8 *) malloc(S * N))
+        {
+            for (tsize_t s = 0; s < N; ++s)
+                TIFFReadEncodedStrip(T, s, b + s * S, S);
+
+            return b;
+        }
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+// If the page of the n given vectors, all on the same page, is decoded, then
+// sample it, mark it most recently used, and return true.
+
+bool scm_sample::find(const scm_point *p, int n, float *k)
+{
+    bool b = false;
+
+    SDL_LockMutex(cache_mutex);
+    {
+        page_m::iterator i = pages.find(p[0].o);
+
+        if (i != pages.end())
+        {
+            for (int m = 0; m < n; ++m)
+                k[p[m].i] = filter(i->second.p, p[m].y, p[m].x);
+
+            order.splice(order.begin(), order, i->second.l);
+            b = true;
+        }
+    }
+    SDL_UnlockMutex(cache_mutex);
+
+    return b;
+}
 
-            if (last_o == o)
+// Take ownership of decoded page buffer b of the page at offset o. Retain it
+// as most recently used, releasing the least recently used pages to remain
+// within the byte budget.
+
+void scm_sample::keep(uint64 o, uint8 *b)
+{
+    const size_t s = size_t(file->get_w()) * size_t(file->get_h())
+                   * size_t(file->get_c()) * size_t(file->get_b() / 8);
+
+    SDL_LockMutex(cache_mutex);
+    {
+        if (s <= size_t(cache_bytes) && pages.find(o) == pages.end())
+        {
+            order.push_front(o);
+
+            page &q = pages[o];
+
+            q.p = b;
+            q.s = s;
+            q.l = order.begin();
+
+            bytes += s;
+            b      = 0;
+
+            while (bytes > size_t(cache_bytes))
             {
-                if (last_i0 != i0 || last_i1 != i1)
-                {
-                    tsize_t S = TIFFStripSize(tiff);
-
-                    if (i0 == i1)
-                        TIFFReadEncodedStrip(tiff, i0, last_p + i0 * S, S);
-                    else
-                    {
-                        TIFFReadEncodedStrip(tiff, i0, last_p + i0 * S, S);
-                        TIFFReadEncodedStrip(tiff, i1, last_p + i1 * S, S);
-                    }
-                    last_i0 = i0;
-                    last_i1 = i1;
-                }
-
-                if (last_i0 == i0 && last_i1 == i1)
-                {
-                    // Sample the cache with linear filtering.
-
-                    float s00 = lookup(r0, c0);
-                    float s01 = lookup(r0, c1);
-                    float s10 = lookup(r1, c0);
-                    float s11 = lookup(r1, c1);
-
-                    double rr = r - floor(r);
-                    double cc = c - floor(c);
-
-                    // Cache the request and its result.
-
-                    last_v[0] = v[0];
-                    last_v[1] = v[1];
-                    last_v[2] = v[2];
-                    last_k    = float(lerp(lerp(s00, s01, cc),
-                                           lerp(s10, s11, cc), rr));
-                }
+                page_m::iterator i = pages.find(order.back());
+
+                bytes -= i->second.s;
+                free(i->second.p);
+                pages.erase(i);
+                order.pop_back();
             }
         }
     }
-    return last_k;
+    SDL_UnlockMutex(cache_mutex);
+
+    free(b);
+}
+
+//------------------------------------------------------------------------------
+
+/// Sampler thread. Answer queries until given an invalid query, which is an
+/// order to shut down.
+
+int sampler(void *data)
+{
+    scm_sample *sample = (scm_sample *) data;
+    scm_query   query;
+
+    while ((query = sample->queries.remove()).id >= 0)
+    {
+        query.k = sample->get(query.v);
+        sample->results.insert(query);
+    }
+    sample->running.set(false);
+    return 0;
 }
 
 //------------------------------------------------------------------------------
 
+/// Batch sampler thread. Sample one share of a large batch using a TIFF handle
+/// borrowed from the pool. An SCM pack needs no handle.
+
+int batcher(void *data)
+{
+    scm_batch *batch = (scm_batch *) data;
+    int        n;
+
+    if (batch->sample->file->get_pack())
+        batch->sample->batch(0, batch->p, batch->n, batch->k);
+
+    else if (TIFF *T = batch->sample->acquire(n))
+    {
+        batch->sample->batch(T, batch->p, batch->n, batch->k);
+        batch->sample->release(T, n);
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
@@ -14,15 +14,60 @@
 #define SCM_SAMPLE_HPP
 
 #include <string>
+#include <vector>
+#include <list>
+#include <map>
 
 #include <tiffio.h>
 
+#include "scm-queue.hpp"
+#include "scm-guard.hpp"
+
 //------------------------------------------------------------------------------
 
 class scm_file;
 
 //------------------------------------------------------------------------------
 
+/// An scm_query represents an asynchronous sample request and its result.
+
+struct scm_query
+{
+    scm_query() : id(-1), k(1.f) { v[0] = v[1] = v[2] = 0; }
+
+    scm_query(int id, const double *w) : id(id), k(1.f)
+    {
+        v[0] = w[0];
+        v[1] = w[1];
+        v[2] = w[2];
+    }
+
+    int    id;    ///< Query identifier, negative to signal exit
+    double v[3];  ///< Sample vector
+    float  k;     ///< Sample result
+
+    /// Order queries first-come first-served.
+
+    bool operator<(const scm_query& that) const { return id < that.id; }
+};
+
+/// An scm_point represents one vector of a batch sample, located within the
+/// deepest page containing it.
+
+struct scm_point
+{
+    uint64 o;  ///< Page file offset
+    double y;  ///< Page row coordinate
+    double x;  ///< Page column coordinate
+    int    i;  ///< Index within the batch
+
+    /// Order points by page.
+
+    bool operator<(const scm_point& that) const { return o < that.o; }
+};
+
+//------------------------------------------------------------------------------
+
 /// An scm_sample samples an SCM TIFF file
 ///
 /// This facility is used primarily to implement collision detection with the
@@ -38,29 +83,92 @@ class scm_file;
 /// frame, running contrary to the spirit of the entire library.
 ///
 /// It's a necessary evil.
+///
+/// The evil may be mitigated by making queries asynchronously. A query made
+/// in this way is answered by a sampler thread, and its result is retrieved
+/// later without blocking. An estimate is returned immediately in the mean
+/// time, drawn from the most recent result or from the page catalog.
+///
+/// Many vectors may be sampled at once. These are grouped by page so that each
+/// page is read once, and large batches are divided among several threads.
+/// Each thread borrows a TIFF handle from a pool, so that the catalog read on
+/// opening is not repeated by every batch.
+///
+/// Decoded pages are retained in a thread-safe least-recently-used cache of
+/// limited size, so that repeated samples of a region need not touch the file.
 
 class scm_sample
 {
 public:
 
+    static int batch_threads;
+    static int batch_size;
+    static int cache_bytes;
+
     scm_sample(scm_file *);
    ~scm_sample();
 
     float get(const double *);
+    void  get(const double *, float *, int);
+    float put(int, const double *, bool&);
+    bool  pop(scm_query&);
+    void  reopen();
 
 private:
 
-    float lookup(int, int) const;
+    float lookup(const uint8 *, int, int)       const;
+    float filter(const uint8 *, double, double) const;
+    bool   batch(TIFF *, const scm_point *, int, float *);
+    uint8  *read(TIFF *, uint64) const;
+    bool   ready() const;
+    bool    find(const scm_point *, int, float *);
+    void    keep(uint64, uint8 *);
+    bool   strip(const scm_point&, float&);
+    TIFF *acquire(int&);
+    void  release(TIFF *, int);
+    float sample(const double *);
+    float  guess(const double *);
 
     TIFF     *tiff;
     scm_file *file;
 
+    SDL_mutex            *mutex;    // Sampler state mutex
+    SDL_Thread           *thread;   // Sampler thread
+    scm_guard<bool>       running;  // Sampler thread running flag
+    scm_queue<scm_query>  queries;  // Query queue
+    scm_queue<scm_query>  results;  // Result queue
+
+    friend int sampler(void *);
+    friend int batcher(void *);
+
     double  last_v[3];  // Sample cache last vector
     float   last_k;     // Sample cache last value
     uint64  last_o;     // Sample cache last page offset
     tsize_t last_i0;    // Sample cache last strip
     tsize_t last_i1;    // Sample cache last strip
     uint8  *last_p;     // Sample cache last page buffer
+
+    // Decoded page cache
+
+    struct page
+    {
+        uint8                      *p;  // Decoded page buffer
+        size_t                      s;  // Decoded page size
+        std::list<uint64>::iterator l;  // Position in recency order
+    };
+
+    typedef std::map<uint64, page> page_m;
+
+    // Batch TIFF handles
+
+    SDL_mutex          *spare_mutex;   // Batch handle pool mutex
+    std::vector<TIFF *> spare;         // Batch handles not in use
+    int                 spare_serial;  // Batch handle generation
+
+    SDL_mutex        *cache_mutex;  // Decoded page cache mutex
+    page_m            pages;        // Decoded pages by file offset
+    std::list<uint64> order;        // Decoded pages, most recently used first
+    size_t            bytes;        // Decoded page total size
 };
 
 //------------------------------------------------------------------------------
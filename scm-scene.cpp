@@ -11,10 +11,15 @@
 // more details.
 
 #include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "util3d/math3d.h"
 
 #include "scm-scene.hpp"
 #include "scm-system.hpp"
 #include "scm-image.hpp"
+#include "scm-index.hpp"
 #include "scm-label.hpp"
 #include "scm-log.hpp"
 
@@ -267,18 +272,31 @@ void scm_scene::unbind_page(int channel, int depth) const
             images[j]->unbind_page(render.program, depth);
 }
 
-/// Touch a page in each image matching a channel. @see scm_image::touch_page
+/// Touch a page in each image matching a channel. The requests of all images
+/// form one load group, so that the page appears in all of them at once.
+/// @see scm_image::touch_page @see scm_system::open_group
 
-void scm_scene::touch_page(int channel, int frame, long long i) const
+void scm_scene::touch_page(int channel, int frame, long long i, float k) const
 {
+    const int g = sys->open_group();
 #if 0
     for (int j = 0; j < get_image_count(); ++j)
         if (images[j]->is_channel(channel))
-            images[j]->touch_page(frame, i);
+            images[j]->touch_page(frame, i, k, g);
 #else
     for (int j = 0; j < get_image_count(); ++j)
-        images[j]->touch_page(frame, i);
+        images[j]->touch_page(frame, i, k, g);
 #endif
+    sys->close_group(g);
+}
+
+/// Prefetch a page in each image, as touch_page requests it in each image.
+/// @see scm_image::fetch_page
+
+void scm_scene::fetch_page(int frame, long long i, float k) const
+{
+    for (int j = 0; j < get_image_count(); ++j)
+        images[j]->fetch_page(frame, i, k);
 }
 
 //------------------------------------------------------------------------------
@@ -297,6 +315,292 @@ float scm_scene::get_current_ground(const double *v) const
     return 1.f;
 }
 
+// Clip the interval [t0, t1] of the ray p + t d to page i of a height field
+// with radii in [r0, r1]. The page is bounded by the four planes of its edges,
+// which are great circles, and by the sphere of radius r1. As the ray cannot
+// pass beneath r0 without hitting the surface, stop it there. Return true if
+// the interval remains non-empty. The radii are widened slightly so that the
+// rounding of single-precision extrema and samples cannot cause the ray to
+// miss a flat page, whose interval would otherwise be empty.
+
+static bool clip_page(const double *p, const double *d, long long i,
+                      double r0, double r1, double& t0, double& t1)
+{
+    static const int e[4][2] = { { 0, 3 }, { 3, 9 }, { 9, 6 }, { 6, 0 } };
+
+    r0 = r0 * (1.0 - 1e-6);
+    r1 = r1 * (1.0 + 1e-6);
+
+    double v[12], c[3], n[3];
+
+    scm_page_corners(i, v);
+
+    c[0] = v[0] + v[3] + v[6] + v[ 9];
+    c[1] = v[1] + v[4] + v[7] + v[10];
+    c[2] = v[2] + v[5] + v[8] + v[11];
+
+    // Clip to the inside of each edge plane.
+
+    for (int k = 0; k < 4; ++k)
+    {
+        vcrs(n, v + e[k][0], v + e[k][1]);
+
+        if (vdot(n, c) < 0)
+            vneg(n, n);
+
+        double a = vdot(n, p);
+        double b = vdot(n, d);
+
+        if      (b > 0) t0 = std::max(t0, -a / b);
+        else if (b < 0) t1 = std::min(t1, -a / b);
+        else if (a < 0) return false;
+    }
+
+    // Clip to the outer sphere.
+
+    double A = vdot(d, d);
+    double B = vdot(p, d);
+    double D = B * B - A * (vdot(p, p) - r1 * r1);
+
+    if (D < 0)
+        return false;
+
+    t0 = std::max(t0, (-B - sqrt(D)) / A);
+    t1 = std::min(t1, (-B + sqrt(D)) / A);
+
+    // Stop at the inner sphere.
+
+    D = B * B - A * (vdot(p, p) - r0 * r0);
+
+    if (D > 0)
+    {
+        double t = (-B - sqrt(D)) / A;
+
+        if (t >= 0)
+            t1 = std::min(t1, t);
+    }
+    return (t0 <= t1);
+}
+
+/// Intersect a ray with the height image, giving the distance to the nearest
+/// intersection. The page tree is traversed front-to-back, rejecting pages
+/// whose bounding volume, given by the page extrema, the ray misses. Height
+/// data is sampled only in the leaf pages that the ray passes through. Return
+/// false if the ray misses. @see scm_system::get_ray_ground
+///
+/// @param p Ray origin relative to the center of the planet.
+/// @param d Ray direction.
+/// @param t Distance to the intersection, in units of the length of d.
+
+bool scm_scene::get_ray_ground(const double *p, const double *d, double& t) const
+{
+    for (int j = 0; j < get_image_count(); ++j)
+        if (images[j]->is_height())
+        {
+            std::pair<double, long long> c[6];
+            int                          n = 0;
+
+            // Clip the ray to each root page and traverse them in order.
+
+            for (long long i = 0; i < 6; ++i)
+            {
+                float  r0;
+                float  r1;
+                double t0 = 0;
+                double t1 = HUGE_VAL;
+
+                images[j]->get_page_bounds(i, r0, r1);
+
+                if (clip_page(p, d, i, r0, r1, t0, t1))
+                    c[n++] = std::make_pair(t0, i);
+            }
+
+            std::sort(c, c + n);
+
+            for (int k = 0; k < n; ++k)
+            {
+                float  r0;
+                float  r1;
+                double t0 = 0;
+                double t1 = HUGE_VAL;
+
+                images[j]->get_page_bounds(c[k].second, r0, r1);
+                clip_page(p, d, c[k].second, r0, r1, t0, t1);
+
+                if (ray_page(images[j], p, d, c[k].second, t0, t1, t))
+                    return true;
+            }
+            return false;
+        }
+
+    // Lacking a height image, intersect the unit sphere.
+
+    double A = vdot(d, d);
+    double B = vdot(p, d);
+    double D = B * B - A * (vdot(p, p) - 1.0);
+
+    if (D >= 0 && (t = (-B - sqrt(D)) / A) >= 0)
+        return true;
+
+    return false;
+}
+
+// Intersect the ray with page i of height image m within the interval [t0, t1]
+// of the ray already clipped to the page. Recurse front-to-back through the
+// children of the page, if it has any, or march through the page data if not.
+// Where a page has only some of its children, the ray is split among the four
+// quadrants, and the data of the page itself is marched through each quadrant
+// lacking a child, bounded by the extrema of the page.
+
+bool scm_scene::ray_page(const scm_image *m, const double *p, const double *d,
+                         long long i, double t0, double t1, double& t) const
+{
+    if (scm_page_level(i) < 24)
+    {
+        std::pair<double, std::pair<double, long long> > c[4];
+
+        int  n    = 0;
+        bool leaf = true;
+        bool have[4];
+
+        for (long long k = 0; k < 4; ++k)
+            if ((have[k] = m->get_page_status(scm_page_child(i, k))))
+                leaf = false;
+
+        if (!leaf)
+        {
+            float p0;
+            float p1;
+
+            m->get_page_bounds(i, p0, p1);
+
+            // Clip the ray to each quadrant, using the extrema of the child if
+            // it is present, or of this page if not. An absent child is noted
+            // by a negative index.
+
+            for (long long k = 0; k < 4; ++k)
+            {
+                long long j = scm_page_child(i, k);
+
+                float  r0 = p0;
+                float  r1 = p1;
+                double u0 = t0;
+                double u1 = t1;
+
+                if (have[k])
+                    m->get_page_bounds(j, r0, r1);
+
+                if (clip_page(p, d, j, r0, r1, u0, u1))
+                    c[n++] = std::make_pair(u0, std::make_pair(u1,
+                                                    have[k] ? j : -1 - j));
+            }
+
+            std::sort(c, c + n);
+
+            for (int k = 0; k < n; ++k)
+            {
+                const long long j  = c[k].second.second;
+                const double    u0 = c[k].first;
+                const double    u1 = c[k].second.first;
+
+                if (j < 0)
+                {
+                    if (ray_leaf(m, p, d, u0, u1, t))
+                        return true;
+                }
+                else
+                {
+                    if (ray_page(m, p, d, j, u0, u1, t))
+                        return true;
+                }
+            }
+            return false;
+        }
+    }
+    return ray_leaf(m, p, d, t0, t1, t);
+}
+
+// March the ray through the data of a leaf page of height image m within the
+// interval [t0, t1], sampling in one batch. Refine the first crossing beneath
+// the surface by bisection.
+
+bool scm_scene::ray_leaf(const scm_image *m, const double *p, const double *d,
+                         double t0, double t1, double& t) const
+{
+    const int n = 256;
+
+    double v[3 * (n + 1)];
+    float  k[n + 1];
+
+    for (int i = 0; i <= n; ++i)
+    {
+        double s = t0 + (t1 - t0) * i / n;
+
+        v[3 * i + 0] = p[0] + d[0] * s;
+        v[3 * i + 1] = p[1] + d[1] * s;
+        v[3 * i + 2] = p[2] + d[2] * s;
+    }
+
+    m->get_page_sample(v, k, n + 1);
+
+    for (int i = 0; i <= n; ++i)
+        if (vlen(v + 3 * i) <= k[i])
+        {
+            if (i == 0)
+                t = t0;
+            else
+            {
+                double a = t0 + (t1 - t0) * (i - 1) / n;
+                double b = t0 + (t1 - t0) * (i    ) / n;
+
+                for (int j = 0; j < 16; ++j)
+                {
+                    double w[3], s = (a + b) / 2;
+
+                    w[0] = p[0] + d[0] * s;
+                    w[1] = p[1] + d[1] * s;
+                    w[2] = p[2] + d[2] * s;
+
+                    if (vlen(w) <= m->get_page_sample(w))
+                        b = s;
+                    else
+                        a = s;
+                }
+                t = b;
+            }
+            return true;
+        }
+
+    return false;
+}
+
+/// Sample the height image at n locations, giving results in k.
+/// @see scm_system::get_current_ground
+
+void scm_scene::get_current_ground(const double *v, float *k, int n) const
+{
+    for (int j = 0; j < get_image_count(); ++j)
+        if (images[j]->is_height())
+        {
+            images[j]->get_page_sample(v, k, n);
+            return;
+        }
+
+    std::fill(k, k + n, 1.f);
+}
+
+/// Begin an asynchronous sample of the height image on behalf of ground query
+/// q, returning an immediate estimate. @see scm_system::get_current_ground
+
+float scm_scene::query_current_ground(const double *v, int q) const
+{
+    for (int j = 0; j < get_image_count(); ++j)
+        if (images[j]->is_height())
+            return images[j]->query_page_sample(v, q);
+
+    return 1.f;
+}
+
 /// Return the smallest value in the height image.
 /// @see scm_system::get_minimum_ground
 
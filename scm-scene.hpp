@@ -109,10 +109,14 @@ public:
 
     void   bind_page(int, int, int, long long) const;
     void unbind_page(int, int)                 const;
-    void  touch_page(int,      int, long long) const;
+    void  touch_page(int,      int, long long, float) const;
+    void  fetch_page(          int, long long, float) const;
 
     float   get_minimum_ground()               const;
     float   get_current_ground(const double *) const;
+    bool    get_ray_ground(const double *, const double *, double&) const;
+    void    get_current_ground(const double *, float *, int) const;
+    float query_current_ground(const double *, int) const;
 
     void    get_page_bounds(int, long long, float&, float &) const;
     bool    get_page_status(int, long long)                  const;
@@ -135,6 +139,11 @@ private:
     GLuint      color;
     GLuint      clear;
 
+    bool ray_page(const scm_image *, const double *, const double *,
+                  long long, double, double, double&) const;
+    bool ray_leaf(const scm_image *, const double *, const double *,
+                                     double, double, double&) const;
+
     // Uniform locations must be visible to the scm_sphere.
 
     friend class scm_sphere;
@@ -18,6 +18,10 @@
 
 //------------------------------------------------------------------------------
 
+scm_set::scm_set() : pin_level(0), pin_limit(0), pin_count(0)
+{
+}
+
 /// Search for the given page in this page set. If found, update the page entry
 /// with the current time t to indicate recent use.
 
@@ -36,24 +40,62 @@ scm_page scm_set::search(scm_page page, int t)
     return scm_page();
 }
 
+/// Search for the given page in this page set without updating its time, so
+/// that a probe does not count as a use.
+
+scm_page scm_set::find(scm_page page) const
+{
+    std::map<scm_page, int>::const_iterator i = m.find(page);
+
+    if (i != m.end())
+        return i->first;
+
+    return scm_page();
+}
+
 /// Add a page to this set, associated with the current time.
 
 void scm_set::insert(scm_page page, int t)
 {
-    m[page] = t;
+    std::pair<std::map<scm_page, int>::iterator, bool> i =
+        m.insert(std::make_pair(page, t));
+
+    if (i.second)
+    {
+        if (is_pinned(page))
+            pin_count++;
+    }
+    else i.first->second = t;
 }
 
 /// Remove a page from this set.
 
 void scm_set::remove(scm_page page)
 {
-    m.erase(page);
+    std::map<scm_page, int>::iterator i = m.find(page);
+
+    if (i != m.end())
+    {
+        if (is_pinned(i->first))
+            pin_count--;
+
+        m.erase(i);
+    }
+}
+
+/// Remove all pages from this set, pinned or not.
+
+void scm_set::clear()
+{
+    m.clear();
+    pin_count = 0;
 }
 
 /// Eject a page from this set to accommodate the addition of a new page.
 ///
 /// The general polity is LRU, but with considerations for time and priority
-/// that help mitigate thrashing.
+/// that help mitigate thrashing. Pinned pages are never chosen, unless there
+/// are more of them than the pin limit, in which case all pages are eligible.
 ///
 /// @param t Current time
 /// @param i Page index
@@ -62,6 +104,9 @@ scm_page scm_set::eject(int t, long long i)
 {
     assert(!m.empty());
 
+    const bool p = (pin_level > 0 || !pin_pages.empty())
+                && (pinned() <= pin_limit);
+
     // Determine the lowest priority and least-recently used pages.
 
     std::map<scm_page, int>::iterator a = m.end();
@@ -69,10 +114,11 @@ scm_page scm_set::eject(int t, long long i)
     std::map<scm_page, int>::iterator e;
 
     for (e = m.begin(); e != m.end(); ++e)
-    {
-        if (a == m.end() || e->second < a->second) a = e;
-                                                   l = e;
-    }
+        if (!p || !is_pinned(e->first))
+        {
+            if (a == m.end() || e->second < a->second) a = e;
+                                                       l = e;
+        }
 
     // If the LRU page was not used in this scene or the last, eject it.
     // Otherwise consider the lowest-priority loaded page and eject if it
@@ -81,18 +127,68 @@ scm_page scm_set::eject(int t, long long i)
     if (a != m.end() && a->second < t - 2)
     {
         scm_page page = a->first;
-        m.erase(a);
+        remove(page);
         return page;
     }
     if (l != m.end() && i < l->first.i)
     {
         scm_page page = l->first;
-        m.erase(l);
+        remove(page);
         return page;
     }
     return scm_page();
 }
 
+/// Pin all pages of level less than l. Set 0 to pin no pages by level.
+
+void scm_set::set_pin_level(int l)
+{
+    pin_level = l;
+    recount();
+}
+
+/// Pin all pages with the given indices, replacing any indices previously
+/// given. Give an empty list to pin no pages by index.
+
+void scm_set::set_pin_pages(const std::vector<long long>& v)
+{
+    pin_pages.clear();
+    pin_pages.insert(v.begin(), v.end());
+    recount();
+}
+
+/// Set the largest number of pinned pages exempt from ejection.
+
+void scm_set::set_pin_limit(int n)
+{
+    pin_limit = n;
+}
+
+/// Return true if the given page is pinned.
+
+bool scm_set::is_pinned(const scm_page& page) const
+{
+    return (scm_page_level(page.i) < pin_level ||
+            (!pin_pages.empty() && pin_pages.find(page.i) != pin_pages.end()));
+}
+
+// Count the pinned pages in the set anew, after the pinned indices change.
+// The count is otherwise kept as pages are inserted and removed.
+
+void scm_set::recount()
+{
+    pin_count = 0;
+
+    if (pin_level > 0 || !pin_pages.empty())
+    {
+        std::map<scm_page, int>::const_iterator i;
+
+        for (i = m.begin(); i != m.end(); ++i)
+            if (is_pinned(i->first))
+                pin_count++;
+    }
+}
+
 /// Return true if the set is empty.
 
 bool scm_set::empty() const
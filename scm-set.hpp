@@ -14,6 +14,8 @@
 #define SCM_SET_HPP
 
 #include <map>
+#include <set>
+#include <vector>
 
 #include "scm-item.hpp"
 
@@ -37,23 +39,47 @@ struct scm_page : public scm_item
 
 /// An scm_set represents an a set of active pages, either currently in
 /// a cache or awaiting loading, with associated insertion time.
+///
+/// Pages may be pinned, either by level or by index, in which case they are
+/// never ejected, up to a limit on the number of pinned pages.
 
 class scm_set
 {
 public:
 
+    scm_set();
+
     scm_page search(scm_page, int);
+    scm_page find  (scm_page) const;
     void     insert(scm_page, int);
     void     remove(scm_page);
+    void     clear();
 
     scm_page eject(int, long long);
 
+    void set_pin_level(int);
+    void set_pin_pages(const std::vector<long long>&);
+    void set_pin_limit(int);
+
+    int  get_pin_level() const { return pin_level; }
+    int  get_pin_limit() const { return pin_limit; }
+
+    bool is_pinned(const scm_page&) const;
+    int  pinned() const { return pin_count; }
+
     bool empty() const;
     void dump()  const;
 
 private:
 
     std::map<scm_page, int> m;
+
+    int                 pin_level;  // Pages of lesser level are pinned
+    std::set<long long> pin_pages;  // Pages of these indices are pinned
+    int                 pin_limit;  // Most pinned pages exempt from ejection
+    int                 pin_count;  // Pinned pages in the set
+
+    void recount();
 };
 
 //------------------------------------------------------------------------------
@@ -14,8 +14,10 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 #include <algorithm>
+#include <functional>
 #include <limits>
 
 #include "util3d/math3d.h"
@@ -37,14 +39,27 @@ typedef GLuint           GLindex;
 
 //------------------------------------------------------------------------------
 
+/// Number of entries in the page geometry cache. This must be a power of two.
+/// Each entry is 128 bytes.
+
+int scm_sphere::corner_cache_size = 8192;
+
+//------------------------------------------------------------------------------
+
 /// Create a new spherical geometry rendering object. Initialize the necessary
 /// OpenGL vertex buffer object state.
 ///
 /// @param d  Detail with which sphere pages are drawn (in vertices)
 /// @param l  Limit at which sphere pages are subdivided (in pixels)
 ///
-scm_sphere::scm_sphere(int d, int l) : detail(d), limit(l)
+scm_sphere::scm_sphere(int d, int l) :
+    detail(d), limit(l), split(1.0), merge(0.8), churn(0)
 {
+    corner c;
+
+    c.i = -1;
+    corners.resize(corner_cache_size, c);
+
     init_arrays(d);
 
     zoomv[0] =  0;
@@ -88,6 +103,27 @@ void scm_sphere::set_limit(int l)
         limit = l;
 }
 
+/// Set the split factor. A page that was not subdivided in the previous frame
+/// is subdivided only when its on-screen size exceeds the limit times k. This
+/// value should be at least 1.
+
+void scm_sphere::set_split(double k)
+{
+    if (1.0 <= k)
+        split = k;
+}
+
+/// Set the merge factor. A page that was subdivided in the previous frame
+/// remains subdivided until its on-screen size falls below the limit times k.
+/// This value should be between 0 and 1. A split and merge of 1 disables the
+/// hysteresis entirely.
+
+void scm_sphere::set_merge(double k)
+{
+    if (0.0 < k && k <= 1.0)
+        merge = k;
+}
+
 //------------------------------------------------------------------------------
 
 /// Prepare to render the sphere. Perform all visibility and subdivision
@@ -103,14 +139,119 @@ void scm_sphere::set_limit(int l)
 void scm_sphere::prep(scm_scene *scene, const double *M,
                       int width, int height, int channel, bool zoom)
 {
+    scm_view view;
+
+    mcpy(view.M, M);
+
+    view.width   = width;
+    view.height  = height;
+    view.channel = channel;
+
+    prep_cut(scene, &view, 1, channel, zoom);
+}
+
+/// Prepare to render the sphere in several views at once. Perform a single
+/// visibility and subdivision pass giving the union of the subdivisions of all
+/// views. Subsequent draw calls made during the same frame with a matching
+/// matrix, viewport, and channel reuse this result, drawing only those pages
+/// visible in their own view.
+///
+/// @param scene   Scene giving the data to be rendered
+/// @param V       Array of views
+/// @param n       Number of views (at most 32)
+/// @param frame   Frame number (for draw call matching)
+
+void scm_sphere::prep(scm_scene *scene, const scm_view *V, int n, int frame)
+{
+    n = std::min(n, int(sizeof (unsigned) * 8));
+
+    if (n > 0)
+    {
+        prep_cut(scene, V, n, -1, scene->uzoomk >= 0);
+
+        cut& c = cuts[cut_key(scene, -1)];
+
+        c.views.assign(V, V + n);
+        c.frame = frame;
+    }
+}
+
+// Perform the visibility pre-pass for n views of the given scene, recalling
+// the previous subdivision stored under the given channel key and storing the
+// new one in its place.
+
+void scm_sphere::prep_cut(scm_scene *scene, const scm_view *V, int n,
+                          int channel, bool zoom)
+{
+    page_m& cut = cuts[cut_key(scene, channel)].pages;
+
+    // Recall the previous subdivision of this scene and channel.
+
+    past.swap(cut);
     pages.clear();
 
-    prep_page(scene, M, width, height, channel, 0, zoom);
-    prep_page(scene, M, width, height, channel, 1, zoom);
-    prep_page(scene, M, width, height, channel, 2, zoom);
-    prep_page(scene, M, width, height, channel, 3, zoom);
-    prep_page(scene, M, width, height, channel, 4, zoom);
-    prep_page(scene, M, width, height, channel, 5, zoom);
+    prep_page(scene, V, n, 0, zoom);
+    prep_page(scene, V, n, 1, zoom);
+    prep_page(scene, V, n, 2, zoom);
+    prep_page(scene, V, n, 3, zoom);
+    prep_page(scene, V, n, 4, zoom);
+    prep_page(scene, V, n, 5, zoom);
+
+    // Count the pages that entered or left the subdivision.
+
+    page_m::const_iterator i = pages.begin();
+    page_m::const_iterator j = past .begin();
+
+    for (churn = 0; i != pages.end() || j != past.end(); )
+    {
+        if      (j == past .end() || (i != pages.end() && i->first < j->first))
+        {
+            ++churn;
+            ++i;
+        }
+        else if (i == pages.end() || j->first < i->first)
+        {
+            ++churn;
+            ++j;
+        }
+        else
+        {
+            ++i;
+            ++j;
+        }
+    }
+
+    // Remember this subdivision for the next prep.
+
+    cut = pages;
+}
+
+// Seek a view matching the given parameters among those of the shared prep of
+// the given scene during the given frame. If found, make that subdivision
+// current by exchanging it with the current one, and return the index of the
+// view. Otherwise return -1. The caller exchanges it back when done.
+
+int scm_sphere::find_cut(scm_scene *scene, const double *M,
+                         int width, int height, int channel, int frame)
+{
+    cut_m::iterator i = cuts.find(cut_key(scene, -1));
+
+    if (i != cuts.end() && i->second.frame == frame)
+    {
+        const scm_view_v& V = i->second.views;
+
+        for (int v = 0; v < int(V.size()); ++v)
+
+            if (V[v].width   == width  &&
+                V[v].height  == height &&
+                V[v].channel == channel && memcmp(V[v].M, M,
+                                                  sizeof (V[v].M)) == 0)
+            {
+                pages.swap(i->second.pages);
+                return v;
+            }
+    }
+    return -1;
 }
 
 /// Render the sphere using cached visibility and subdivision state.
@@ -127,16 +268,33 @@ void scm_sphere::draw(scm_scene *scene, const double *M,
 {
     glEnable(GL_COLOR_MATERIAL);
 
-    // Perform the visibility pre-pass.
+    // Perform the visibility pre-pass, unless a shared prep covers this view.
+
+    int v = find_cut(scene, M, width, height, channel, frame);
+
+    const bool shared = (v >= 0);
+
+    if (v < 0)
+    {
+        prep(scene, M, width, height, channel, scene->uzoomk >= 0);
+        v = 0;
+    }
+
+    const unsigned b = 1U << v;
+
+    // Pre-cache all visible pages in order of decreasing priority.
 
-    prep(scene, M, width, height, channel, scene->uzoomk >= 0);
+    std::vector<std::pair<float, long long> > touch;
 
-    // Pre-cache all visible pages in breadth-first order.
+    for (page_m::iterator i = pages.begin(); i != pages.end(); ++i)
+        if (i->second.b & b)
+            touch.push_back(std::make_pair(i->second.k, i->first));
 
-    std::set<long long>::iterator i;
+    std::sort(touch.begin(), touch.end(),
+              std::greater<std::pair<float, long long> >());
 
-    for (i = pages.begin(); i != pages.end(); ++i)
-        scene->touch_page(channel, frame, (*i));
+    for (size_t j = 0; j < touch.size(); ++j)
+        scene->touch_page(channel, frame, touch[j].second, touch[j].first);
 
     // Bind the vertex buffer.
 
@@ -162,35 +320,35 @@ void scm_sphere::draw(scm_scene *scene, const double *M,
                                    GLfloat(zoomv[1]),
                                    GLfloat(zoomv[2]));
 
-        if (is_set(0))
+        if (is_seen(0, b))
         {
             glUniformMatrix3fv(scene->uM, 1, GL_TRUE, M[0]);
-            draw_page(scene, channel, 0, frame, 0);
+            draw_page(scene, channel, 0, frame, b, 0);
         }
-        if (is_set(1))
+        if (is_seen(1, b))
         {
             glUniformMatrix3fv(scene->uM, 1, GL_TRUE, M[1]);
-            draw_page(scene, channel, 0, frame, 1);
+            draw_page(scene, channel, 0, frame, b, 1);
         }
-        if (is_set(2))
+        if (is_seen(2, b))
         {
             glUniformMatrix3fv(scene->uM, 1, GL_TRUE, M[2]);
-            draw_page(scene, channel, 0, frame, 2);
+            draw_page(scene, channel, 0, frame, b, 2);
         }
-        if (is_set(3))
+        if (is_seen(3, b))
         {
             glUniformMatrix3fv(scene->uM, 1, GL_TRUE, M[3]);
-            draw_page(scene, channel, 0, frame, 3);
+            draw_page(scene, channel, 0, frame, b, 3);
         }
-        if (is_set(4))
+        if (is_seen(4, b))
         {
             glUniformMatrix3fv(scene->uM, 1, GL_TRUE, M[4]);
-            draw_page(scene, channel, 0, frame, 4);
+            draw_page(scene, channel, 0, frame, b, 4);
         }
-        if (is_set(5))
+        if (is_seen(5, b))
         {
             glUniformMatrix3fv(scene->uM, 1, GL_TRUE, M[5]);
-            draw_page(scene, channel, 0, frame, 5);
+            draw_page(scene, channel, 0, frame, b, 5);
         }
     }
     scene->unbind(channel);
@@ -200,6 +358,84 @@ void scm_sphere::draw(scm_scene *scene, const double *M,
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER,         0);
     glDisableClientState(GL_VERTEX_ARRAY);
+
+    // Return a shared subdivision to its prep, for the draws of other views.
+
+    if (shared)
+        pages.swap(cuts[cut_key(scene, -1)].pages);
+}
+
+/// Request the pages of an anticipated view in advance of their need. Perform
+/// the visibility and subdivision calculations for the given view, and issue
+/// prefetch requests for all resulting pages in order of decreasing priority.
+/// The subdivision history of the scene is consulted but left unchanged.
+///
+/// @param scene   Scene giving the data to be rendered
+/// @param M       Anticipated model-view-projection matrix
+/// @param width   Width of the render target (in pixels)
+/// @param height  Height of the render target (in pixels)
+/// @param channel Channel index
+/// @param frame   Frame number
+
+void scm_sphere::prefetch(scm_scene *scene, const double *M,
+                         int width, int height, int channel, int frame)
+{
+    scm_view view;
+
+    mcpy(view.M, M);
+
+    view.width   = width;
+    view.height  = height;
+    view.channel = channel;
+
+    page_m& cut = cuts[cut_key(scene, channel)].pages;
+
+    // Subdivide relative to the current history, without replacing it.
+
+    page_m save;
+
+    save.swap(pages);
+    past.swap(cut);
+
+    const bool zoom = scene->uzoomk >= 0;
+
+    prep_page(scene, &view, 1, 0, zoom);
+    prep_page(scene, &view, 1, 1, zoom);
+    prep_page(scene, &view, 1, 2, zoom);
+    prep_page(scene, &view, 1, 3, zoom);
+    prep_page(scene, &view, 1, 4, zoom);
+    prep_page(scene, &view, 1, 5, zoom);
+
+    past.swap(cut);
+
+    // Request the pages in order of decreasing priority.
+
+    std::vector<std::pair<float, long long> > fetch;
+
+    for (page_m::iterator i = pages.begin(); i != pages.end(); ++i)
+        fetch.push_back(std::make_pair(i->second.k, i->first));
+
+    std::sort(fetch.begin(), fetch.end(),
+              std::greater<std::pair<float, long long> >());
+
+    for (size_t j = 0; j < fetch.size(); ++j)
+        scene->fetch_page(frame, fetch[j].second, fetch[j].first);
+
+    pages.swap(save);
+}
+
+/// Forget the subdivision history of a scene. This should be called when a
+/// scene is deleted.
+
+void scm_sphere::del_scene(const scm_scene *scene)
+{
+    cut_m::iterator i = cuts.begin();
+
+    while (i != cuts.end())
+        if (i->first.first == scene)
+            cuts.erase(i++);
+        else
+            ++i;
 }
 
 /// Set the direction and magnitude of the zoom.
@@ -269,7 +505,7 @@ double scm_sphere::view_page(const double *M, int vw, int vh,
 {
     double v[12];
 
-    scm_page_corners(i, v);
+    memcpy(v, get_corners(i), 12 * sizeof (double));
 
     if (zoomb && zoomk != 1)
     {
@@ -406,57 +642,139 @@ double scm_sphere::view_page(const double *M, int vw, int vh,
                              length(B, D, vw, vh)));
 }
 
+// Determine the largest on-screen size of page i among n views, and set a
+// bit in mask b for each view in which the page is visible. Return the page's
+// greatest load priority among these views in p.
+
+double scm_sphere::view_page(const scm_view *V, int n, double r0, double r1,
+                             long long i, bool zoom, unsigned& b, float& p)
+{
+    double k = 0;
+
+    for (int v = 0; v < n; ++v)
+    {
+        double d = view_page(V[v].M, V[v].width, V[v].height, r0, r1, i, zoom);
+
+        if (d > 0)
+        {
+            k  = std::max(k, d);
+            b |= 1U << v;
+            p  = std::max(p, float(prio_page(V[v].M, r1, i, zoom, d)));
+        }
+    }
+    return k;
+}
+
+// Return the corner vectors of page i, as given by scm_page_corners, followed
+// by its normalized center. The cache is direct-mapped by a hash of the page
+// index. Corners are never derived from parent corners, as the spherical
+// midpoint of two corners differs from the corner of the child page.
+
+const double *scm_sphere::get_corners(long long i)
+{
+    const unsigned long long h = (unsigned long long) i * 0x9E3779B97F4A7C15ULL;
+
+    corner& c = corners[(h >> 32) & (corners.size() - 1)];
+
+    if (c.i != i)
+    {
+        double *v = c.v;
+
+        scm_page_corners(i, v);
+
+        v[12] = v[0] + v[3] + v[6] + v[ 9];
+        v[13] = v[1] + v[4] + v[7] + v[10];
+        v[14] = v[2] + v[5] + v[8] + v[11];
+
+        vnormalize(v + 12, v + 12);
+
+        c.i = i;
+    }
+    return c.v;
+}
+
+// Compute the load priority of page i given its on-screen size d. Priority is
+// proportional to size and falls off with the distance of the page center from
+// the center of the screen and with the level of the page.
+
+double scm_sphere::prio_page(const double *M, double r,
+                             long long i, bool zoomb, double d)
+{
+    const double *c = get_corners(i) + 12;
+
+    double u[3], w[4];
+
+    u[0] = c[0];
+    u[1] = c[1];
+    u[2] = c[2];
+
+    if (zoomb && zoomk != 1)
+        zoom(u, u);
+
+    // Project the page center and find its normalized distance from center.
+
+    w[0] = M[0] * u[0] * r + M[4] * u[1] * r + M[ 8] * u[2] * r + M[12];
+    w[1] = M[1] * u[0] * r + M[5] * u[1] * r + M[ 9] * u[2] * r + M[13];
+    w[3] = M[3] * u[0] * r + M[7] * u[1] * r + M[11] * u[2] * r + M[15];
+
+    double e = (w[3] > 0) ? sqrt(w[0] * w[0] + w[1] * w[1]) / w[3] : 2.0;
+
+    return std::min(d, 1e6) / ((1.0 + std::min(e, 2.0))
+                             * (1.0 + double(scm_page_level(i))));
+}
+
 //------------------------------------------------------------------------------
 
 // Add page i to the set of pages needed for this scene. Recursively traverse
 // the neighborhood of this branch, adding pages to ensure that no two visibly
 // adjacent pages differ by more than one level of detail.
 
-void scm_sphere::add_page(const double *M,
-                                   int width,
-                                   int height,
+void scm_sphere::add_page(const scm_view *V, int n,
                                 double r0,
                                 double r1, long long i, bool zoom)
 {
     if (!is_set(i))
     {
-        double k = view_page(M, width, height, r0, r1, i, zoom);
+        unsigned b = 0;
+        float    p = 0;
+
+        double k = view_page(V, n, r0, r1, i, zoom, b, p);
 
         if (k > 0)
         {
-            pages.insert(i);
+            pages.insert(page_m::value_type(i, page_v(b, p)));
 
             if (i > 5)
             {
-                long long p = scm_page_parent(i);
+                long long parent = scm_page_parent(i);
 
-                add_page(M, width, height, r0, r1, p, zoom);
+                add_page(V, n, r0, r1, parent, zoom);
 
                 switch (scm_page_order(i))
                 {
                     case 0:
-                        add_page(M, width, height, r0, r1, scm_page_north(p), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_south(i), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_east (i), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_west (p), zoom);
+                        add_page(V, n, r0, r1, scm_page_north(parent), zoom);
+                        add_page(V, n, r0, r1, scm_page_south(i), zoom);
+                        add_page(V, n, r0, r1, scm_page_east (i), zoom);
+                        add_page(V, n, r0, r1, scm_page_west (parent), zoom);
                         break;
                     case 1:
-                        add_page(M, width, height, r0, r1, scm_page_north(p), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_south(i), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_east (p), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_west (i), zoom);
+                        add_page(V, n, r0, r1, scm_page_north(parent), zoom);
+                        add_page(V, n, r0, r1, scm_page_south(i), zoom);
+                        add_page(V, n, r0, r1, scm_page_east (parent), zoom);
+                        add_page(V, n, r0, r1, scm_page_west (i), zoom);
                         break;
                     case 2:
-                        add_page(M, width, height, r0, r1, scm_page_north(i), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_south(p), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_east (i), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_west (p), zoom);
+                        add_page(V, n, r0, r1, scm_page_north(i), zoom);
+                        add_page(V, n, r0, r1, scm_page_south(parent), zoom);
+                        add_page(V, n, r0, r1, scm_page_east (i), zoom);
+                        add_page(V, n, r0, r1, scm_page_west (parent), zoom);
                         break;
                     case 3:
-                        add_page(M, width, height, r0, r1, scm_page_north(i), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_south(p), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_east (p), zoom);
-                        add_page(M, width, height, r0, r1, scm_page_west (i), zoom);
+                        add_page(V, n, r0, r1, scm_page_north(i), zoom);
+                        add_page(V, n, r0, r1, scm_page_south(parent), zoom);
+                        add_page(V, n, r0, r1, scm_page_east (parent), zoom);
+                        add_page(V, n, r0, r1, scm_page_west (i), zoom);
                         break;
                 }
             }
@@ -465,47 +783,74 @@ void scm_sphere::add_page(const double *M,
 }
 
 bool scm_sphere::prep_page(scm_scene *scene,
-                        const double *M,
-                                  int width,
-                                  int height,
-                                  int channel, long long i, bool zoom)
+                     const scm_view *V, int n, long long i, bool zoom)
 {
     float t0;
     float t1;
 
-    // If this page is missing from all data sets, skip it.
+    // If this page is missing from all data sets of all views, skip it.
+
+    bool status = false;
 
-    if (scene->get_page_status(channel, i))
+    for (int v = 0; v < n && !status; ++v)
+        status = scene->get_page_status(V[v].channel, i);
+
+    if (status)
     {
-        scene->get_page_bounds(channel, i, t0, t1);
+        // Bound the page by the union of the bounds of each distinct channel.
+
+        scene->get_page_bounds(V[0].channel, i, t0, t1);
+
+        for (int v = 1; v < n; ++v)
+        {
+            int w = 0;
+
+            while (w < v && V[w].channel != V[v].channel)
+                w++;
+
+            if (w == v)
+            {
+                float u0;
+                float u1;
+
+                scene->get_page_bounds(V[v].channel, i, u0, u1);
+
+                t0 = std::min(t0, u0);
+                t1 = std::max(t1, u1);
+            }
+        }
 
         double r0 = double(t0);
         double r1 = double(t1);
 
-        // Compute the on-screen pixel size of this page.
+        // Compute the largest on-screen pixel size of this page in any view.
+
+        unsigned b = 0;
+        float    p = 0;
 
-        double k = view_page(M, width, height, r0, r1, i, zoom);
+        double k = view_page(V, n, r0, r1, i, zoom, b, p);
 
-        // Subdivide if too large, otherwise mark for drawing.
+        // Subdivide if too large, otherwise mark for drawing. Pages that were
+        // subdivided last time merge at a lower threshold than others split.
 
         if (k > 0)
         {
-            if (k > limit)
+            if (k > limit * (was_split(i) ? merge : split))
             {
                 long long i0 = scm_page_child(i, 0);
                 long long i1 = scm_page_child(i, 1);
                 long long i2 = scm_page_child(i, 2);
                 long long i3 = scm_page_child(i, 3);
 
-                bool b0 = prep_page(scene, M, width, height, channel, i0, zoom);
-                bool b1 = prep_page(scene, M, width, height, channel, i1, zoom);
-                bool b2 = prep_page(scene, M, width, height, channel, i2, zoom);
-                bool b3 = prep_page(scene, M, width, height, channel, i3, zoom);
+                bool b0 = prep_page(scene, V, n, i0, zoom);
+                bool b1 = prep_page(scene, V, n, i1, zoom);
+                bool b2 = prep_page(scene, V, n, i2, zoom);
+                bool b3 = prep_page(scene, V, n, i3, zoom);
 
                 if (b0 || b1 || b2 || b3)
                     return true;
             }
-            add_page(M, width, height, r0, r1, i, zoom);
+            add_page(V, n, r0, r1, i, zoom);
 
             return true;
         }
@@ -513,8 +858,27 @@ bool scm_sphere::prep_page(scm_scene *scene,
     return false;
 }
 
-void scm_sphere::draw_page(scm_scene *scene,
-                           int channel, int depth, int frame, long long i)
+// Return true if page i was subdivided in the previous prep of this scene.
+
+bool scm_sphere::was_split(long long i) const
+{
+    return was_set(scm_page_child(i, 0))
+        || was_set(scm_page_child(i, 1))
+        || was_set(scm_page_child(i, 2))
+        || was_set(scm_page_child(i, 3));
+}
+
+// Return true if page i is marked for drawing in any view of mask b.
+
+bool scm_sphere::is_seen(long long i, unsigned b) const
+{
+    page_m::const_iterator j = pages.find(i);
+
+    return (j != pages.end() && (j->second.b & b));
+}
+
+void scm_sphere::draw_page(scm_scene *scene, int channel, int depth,
+                                             int frame, unsigned b, long long i)
 {
     scene->bind_page(channel, depth, frame, i);
     {
@@ -530,12 +894,12 @@ void scm_sphere::draw_page(scm_scene *scene,
 
         if (b0 || b1 || b2 || b3)
         {
-            // Draw any children marked for drawing.
+            // Draw any children marked for drawing and visible in this view.
 
-            if (b0) draw_page(scene, channel, depth + 1, frame, i0);
-            if (b1) draw_page(scene, channel, depth + 1, frame, i1);
-            if (b2) draw_page(scene, channel, depth + 1, frame, i2);
-            if (b3) draw_page(scene, channel, depth + 1, frame, i3);
+            if (is_seen(i0, b)) draw_page(scene, channel, depth + 1, frame, b, i0);
+            if (is_seen(i1, b)) draw_page(scene, channel, depth + 1, frame, b, i1);
+            if (is_seen(i2, b)) draw_page(scene, channel, depth + 1, frame, b, i2);
+            if (is_seen(i3, b)) draw_page(scene, channel, depth + 1, frame, b, i3);
         }
         else
         {
@@ -16,16 +16,54 @@
 #include <GL/glew.h>
 #include <vector>
 #include <set>
+#include <map>
 
 #include "scm-scene.hpp"
 
 //------------------------------------------------------------------------------
 
+/// An scm_view describes one of several views of the sphere, such as the eyes
+/// of a stereo pair or the faces of a cube map capture, that share a single
+/// visibility and subdivision pass. @see scm_sphere::prep
+
+struct scm_view
+{
+    double M[16];   ///< Model-view-projection matrix in column-major order
+    int    width;   ///< Width of the render target (in pixels)
+    int    height;  ///< Height of the render target (in pixels)
+    int    channel; ///< Channel index
+};
+
+typedef std::vector<scm_view> scm_view_v;
+
+//------------------------------------------------------------------------------
+
 /// An scm_sphere generates the adaptive rendered geometry of the 3D sphere.
 ///
 /// The sphere performs all visibility testing and subdivision necessary to
 /// optimally render a given scene. Detail and limit parameters tune this
 /// facility. Optional zoom direction and degree are maintained if needed.
+///
+/// The subdivision of each scene and channel is remembered from one prep to
+/// the next. Split and merge factors apply hysteresis to the limit so that a
+/// page hovering near the threshold does not flip between itself and its
+/// children from frame to frame, which would otherwise churn page requests.
+/// The churn count gives the number of pages that entered or left the most
+/// recent subdivision, relative to the previous one.
+///
+/// A shared prep computes the union subdivision of up to 32 views in a single
+/// traversal and records the views in which each page is visible. A draw that
+/// matches one of those views during the same frame reuses the shared result
+/// and draws only the pages visible to it.
+///
+/// The corner and center vectors of recently visited pages are memoized in a
+/// small direct-mapped cache, so that a steady view performs almost no page
+/// geometry trigonometry during traversal.
+///
+/// Each visible page receives a load priority that favors pages that are large
+/// on screen, near the center of view, and coarse. Pages are requested in order
+/// of decreasing priority, and the priority travels with the request through
+/// the loader queues, so that the pages dominating the view arrive first.
 
 class scm_sphere
 {
@@ -36,19 +74,31 @@ public:
 
     void set_detail(int d);
     void set_limit (int l);
+    void set_split (double k);
+    void set_merge (double k);
 
-    int  get_detail() const { return detail; }
-    int  get_limit () const { return limit;  }
+    int    get_detail() const { return detail; }
+    int    get_limit () const { return limit;  }
+    double get_split () const { return split;  }
+    double get_merge () const { return merge;  }
+    int    get_churn () const { return churn;  }
 
     void prep(scm_scene *, const double *, int, int, int, bool);
+    void prep(scm_scene *, const scm_view *, int, int);
     void draw(scm_scene *, const double *, int, int, int, int);
+    void prefetch(scm_scene *, const double *, int, int, int, int);
 
     void set_zoom(double x, double y, double z, double k);
 
+    void del_scene(const scm_scene *);
+
 private:
 
-    int detail;
-    int limit;
+    int    detail;
+    int    limit;
+    double split;
+    double merge;
+    int    churn;
 
     // Zooming state.
 
@@ -59,17 +109,64 @@ private:
 
     // Data structures and algorithms for handling face adaptive subdivision.
 
-    std::set<long long> pages;
+    struct page_v
+    {
+        page_v(unsigned b, float k) : b(b), k(k) { }
+
+        unsigned b;  // Mask of the views seeing this page
+        float    k;  // Load priority of this page
+    };
+
+    typedef std::map<long long, page_v>       page_m;
+    typedef std::pair<const scm_scene *, int> cut_key;
+
+    struct cut
+    {
+        cut() : frame(-1) { }
+
+        page_m     pages;  // Pages, with view masks and priorities
+        scm_view_v views;  // Views of a shared prep
+        int        frame;  // Frame of a shared prep
+    };
+
+    typedef std::map<cut_key, cut> cut_m;
+
+    page_m pages;  // Pages of the current prep
+    page_m past;   // Pages of the previous prep of the same scene and channel
+    cut_m  cuts;   // Pages of the previous prep of each scene and channel
+
+    void    prep_cut(scm_scene *, const scm_view *, int, int, bool);
+    int     find_cut(scm_scene *, const double *, int, int, int, int);
 
     bool     is_set (long long i) const { return (pages.find(i) != pages.end()); }
+    bool    was_set (long long i) const { return (past .find(i) != past .end()); }
+    bool    is_seen (long long i, unsigned b) const;
+    bool    was_split(long long i) const;
     void    set_page(long long i);
 
-    void    add_page(const double *, int, int, double, double, long long, bool);
+    void    add_page(const scm_view *, int, double, double, long long, bool);
     double view_page(const double *, int, int, double, double, long long, bool);
+    double view_page(const scm_view *, int, double, double, long long, bool,
+                     unsigned&, float&);
+    double prio_page(const double *, double, long long, bool, double);
+
+    // Page geometry cache.
+
+    struct corner
+    {
+        long long i;      // Page index, or -1 if empty
+        double    v[15];  // Four corner vectors followed by the center vector
+    };
+
+    std::vector<corner> corners;
+
+    static int corner_cache_size;
+
+    const double *get_corners(long long);
     void  debug_page(const double *,           double, double, long long);
 
-    bool   prep_page(scm_scene *, const double *, int, int, int, long long, bool);
-    void   draw_page(scm_scene *,                 int, int, int, long long);
+    bool   prep_page(scm_scene *, const scm_view *, int, long long, bool);
+    void   draw_page(scm_scene *, int, int, int, unsigned, long long);
 
     // OpenGL geometry state.
 
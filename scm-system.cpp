@@ -16,6 +16,7 @@
 #include <cassert>
 #include <limits>
 #include <cmath>
+#include <cstring>
 #include "util3d/math3d.h"
 
 #include <tiffio.h>
@@ -48,8 +49,14 @@
 /// @param l  Limit at which sphere pages are subdivided (in pixels)
 
 scm_system::scm_system(int w, int h, int d, int l) :
-    serial(1), frame(0), sync(false), fade(0)
+    serial(1), query(0), frame(0), sync(false), fade(0), ahead(8),
+    group(0), group_wait(30), group_count(0), group_partial(0), group_broken(0),
+    pin_level(0), pin_fetch(false),
+    tour_ahead(120), tour_frame(-1), tour_t(0), tour_dt(0), tour_next(0)
 {
+    motion_t[0] = -1;
+    motion_t[1] = -1;
+
     TIFFSetWarningHandler(0);
     TIFFSetErrorHandler  (0);
 
@@ -72,6 +79,10 @@ scm_system::~scm_system()
     while (get_scene_count())
         del_scene(0);
 
+    // Fail any ground queries still outstanding.
+
+    finish_ground(true);
+
     delete path;
     delete sphere;
     delete render;
@@ -81,6 +92,27 @@ scm_system::~scm_system()
 
 //------------------------------------------------------------------------------
 
+/// Prepare the sphere for rendering in several channels at once. Stereo and
+/// multi-view applications may call this once per frame, before rendering
+/// each channel, so that all channels share a single visibility traversal.
+/// Calling it is optional; render_sphere prepares each channel separately in
+/// its absence.
+///
+/// @see scm_render::prep
+///
+/// @param P        Array of n projection matrices in column-major OpenGL form
+/// @param M        Array of n model-view matrices in column-major OpenGL form
+/// @param channel  Array of n channel indices
+/// @param n        Number of channels
+
+void scm_system::prep_sphere(const double *P,
+                             const double *M, const int *channel, int n) const
+{
+    if (!scenes.empty())
+        render->prep(sphere, fore0, fore1,
+                             back0, back1, P, M, channel, n, frame, fade);
+}
+
 /// Render the sphere. This is among the most significant entry points of the
 /// SCM API as it is the simplest function that accomplishes the goal. It should
 /// be called once per frame.
@@ -88,6 +120,10 @@ scm_system::~scm_system()
 /// The request is forwarded directly to the render handler, augmented with the
 /// current foreground and background scenes and cross-fade parameters.
 ///
+/// The model-view matrix of the first call of each frame is recorded. If the
+/// camera is moving, its motion is extrapolated to anticipate the view several
+/// frames ahead, and the pages of that view are prefetched. @see set_prefetch
+///
 /// @see scm_render::render
 ///
 /// @param P        Projection matrix in column-major OpenGL form
@@ -102,8 +138,156 @@ void scm_system::render_sphere(const double *P,
         glClearColor(0.2f, 0.2f, 0.2f, 0.0f);
         glClear(GL_COLOR_BUFFER_BIT);
     }
-    else render->render(sphere, fore0, fore1,
-                                back0, back1, P, M, channel, frame, fade);
+    else
+    {
+        render->render(sphere, fore0, fore1,
+                               back0, back1, P, M, channel, frame, fade);
+
+        if (motion_t[1] != frame)
+        {
+            double A[16];
+
+            if (predict(M, A) && ahead > 0)
+                render->prefetch(sphere, fore0, fore1,
+                                         back0, back1, P, A, channel, frame, fade);
+
+            if (tour_ahead > 0 && tour_frame == frame && tour_dt > 0)
+                tour_prefetch(P, M, channel);
+
+            if (!pin_pages.empty())
+                pin_prefetch();
+        }
+    }
+}
+
+// Prefetch the pages of a view that playback of the step queue will reach in
+// the near future. Each frame samples one of several times spread across the
+// look-ahead interval, so the cost of the traversal is spread across frames.
+// The application's transform relative to the current step is assumed to hold
+// for the future step, so that head tracking and the like are respected.
+
+void scm_system::tour_prefetch(const double *P, const double *M, int channel) const
+{
+    const int n = 4;
+    const int j = tour_next++ % n;
+
+    double t = std::min(tour_t + tour_dt * tour_ahead * (j + 1) / n,
+                        double(queue.size() - 1));
+
+    if (t > tour_t)
+    {
+        double S[16], O[16], I[16], A[16];
+
+        // O maps the current step's frame into the current view.
+
+        get_step_blend(tour_t).get_matrix(S);
+        mmultiply(O, M, S);
+
+        // Apply it to the future step to give the future view.
+
+        tour_step(t).get_matrix(S);
+        minvert(I, S);
+        mmultiply(A, O, I);
+
+        scm_scene *f0, *f1, *b0, *b1;
+
+        get_queue_scenes(t, f0, f1, b0, b1);
+
+        render->prefetch(sphere, f0, f1, b0, b1, P, A, channel, frame,
+                         t - floor(t));
+    }
+}
+
+// Prefetch the pinned pages of every file, so that the pages around points of
+// interest are resident before they are first viewed. This follows the view
+// prefetches and uses the lowest prefetch priority. Pages beyond this frame's
+// prefetch budget are requested in a later frame. Once every pinned page is
+// resident, or every cache holds as many pinned pages as its limit allows, the
+// pass stops until the pinned pages or the files change. A cache at its limit
+// is passed over, so that pinning beyond it does not churn the cache.
+
+void scm_system::pin_prefetch() const
+{
+    if (pin_fetch)
+    {
+        bool lack = false;
+
+        active_pair_m::const_iterator i;
+
+        for (i = pairs.begin(); i != pairs.end(); ++i)
+        {
+            scm_cache *cache = i->second.cache;
+
+            if (cache->get_pin_count() < cache->get_pin_limit())
+                for (size_t j = 0; j < pin_pages.size(); ++j)
+                    if (cache->lacks_page(i->first, pin_pages[j]))
+                    {
+                        cache->fetch_page(i->first, pin_pages[j], frame, 0.f);
+                        lack = true;
+                    }
+        }
+        pin_fetch = lack;
+    }
+}
+
+// Return the step queue interpolated linearly at time t. Unlike get_step_blend
+// this does not snap to whole steps, so that a look-ahead of less than one step
+// still anticipates a view other than the current one.
+
+scm_step scm_system::tour_step(double t) const
+{
+    if (queue.empty())
+        return scm_step();
+
+    t = std::max(t, 0.0);
+    t = std::min(t, double(queue.size() - 1));
+
+    const int i = int(floor(t));
+
+    if (i + 1 < int(queue.size()))
+        return scm_step(queue[i], queue[i + 1], t - i);
+    else
+        return scm_step(queue[i]);
+}
+
+// Record the first model-view matrix given during each frame. If the camera
+// moved since the previous frame, extrapolate that motion to anticipate the
+// model-view matrix of the frame the prefetch look-ahead distance in the
+// future, and return true.
+
+bool scm_system::predict(const double *M, double *A) const
+{
+    if (motion_t[1] == frame)
+        return false;
+
+    mcpy(motion_M[0], motion_M[1]);
+    mcpy(motion_M[1], M);
+
+    motion_t[0] = motion_t[1];
+    motion_t[1] = frame;
+
+    if (motion_t[0] == frame - 1 && memcmp(motion_M[0], motion_M[1],
+                                           sizeof (motion_M[0])) != 0)
+    {
+        double D[16];
+        double I[16];
+        double T[16];
+
+        // D transforms the previous view into the current one.
+
+        minvert  (I, motion_M[0]);
+        mmultiply(D, motion_M[1], I);
+
+        mcpy(A, motion_M[1]);
+
+        for (int k = 0; k < ahead; ++k)
+        {
+            mmultiply(T, D, A);
+            mcpy(A, T);
+        }
+        return true;
+    }
+    return false;
 }
 
 //------------------------------------------------------------------------------
@@ -168,6 +352,8 @@ void scm_system::del_scene(int i)
     if (scenes[i] == fore1) fore1 = 0;
     if (scenes[i] == back1) back1 = 0;
 
+    sphere->del_scene(scenes[i]);
+
     delete scenes[i];
     scenes.erase(scenes.begin() + i);
 }
@@ -191,6 +377,10 @@ int scm_system::get_scene_count() const
 
 /// Set the scene caches and fade coefficient to produce a rendering of the
 /// current step queue at time t.
+///
+/// The rate at which t advances from frame to frame is noted. During playback,
+/// render_sphere uses it to prefetch the pages of the views that the queue
+/// will reach in the near future. @see set_tour_prefetch
 
 double scm_system::set_scene_blend(double t)
 {
@@ -199,13 +389,13 @@ double scm_system::set_scene_blend(double t)
         t = std::max(t, 0.0);
         t = std::min(t, double(queue.size() - 1));
 
-        scm_step *step0 = queue[int(floor(t))];
-        scm_step *step1 = queue[int( ceil(t))];
+        get_queue_scenes(t, fore0, fore1, back0, back1);
+
+        if      (tour_frame == frame - 1) tour_dt = t - tour_t;
+        else if (tour_frame != frame)     tour_dt = 0;
 
-        fore0 = find_scene(step0->get_foreground());
-        fore1 = find_scene(step1->get_foreground());
-        back0 = find_scene(step0->get_background());
-        back1 = find_scene(step1->get_background());
+        tour_t     = t;
+        tour_frame = frame;
 
         fade = t - floor(t);
         return t;
@@ -217,6 +407,20 @@ double scm_system::set_scene_blend(double t)
     }
 }
 
+// Find the scenes at either end of the dissolve at time t of the step queue.
+
+void scm_system::get_queue_scenes(double t, scm_scene *& f0, scm_scene *& f1,
+                                            scm_scene *& b0, scm_scene *& b1) const
+{
+    scm_step *step0 = queue[int(floor(t))];
+    scm_step *step1 = queue[int( ceil(t))];
+
+    f0 = find_scene(step0->get_foreground());
+    f1 = find_scene(step1->get_foreground());
+    b0 = find_scene(step0->get_background());
+    b1 = find_scene(step1->get_background());
+}
+
 //------------------------------------------------------------------------------
 
 /// Allocate and insert a new step before index i. Return its index.
@@ -409,9 +613,136 @@ void scm_system::update_cache()
 {
     for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
         i->second.cache->update(frame, sync);
+
+    // Release the load groups that are complete or have waited too long, and
+    // upload their pages to all caches together.
+
+    if (!groups.empty())
+    {
+        bool partial = false;
+
+        for (load_group_m::iterator i = groups.begin(); i != groups.end(); ++i)
+        {
+            if (i->second.done)
+                continue;
+            if (i->second.a >= i->second.n)
+                i->second.done = true;
+            else if (frame - i->second.t >= group_wait)
+            {
+                i->second.done = true;
+                group_broken++;
+            }
+            else if (i->second.a > 0)
+                partial = true;
+        }
+        if (partial)
+            group_partial++;
+    }
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+        i->second.cache->release(frame);
+
+    for (load_group_m::iterator i = groups.begin(); i != groups.end(); )
+        if (i->second.done)
+            groups.erase(i++);
+        else
+            ++i;
+
+    update_ground();
     frame++;
 }
 
+// Gather the results of asynchronous file samples and deliver the results of
+// all completed ground queries. @see get_current_ground
+
+void scm_system::update_ground()
+{
+    if (!grounds.empty())
+    {
+        // Accumulate completed samples into their queries.
+
+        for (active_file_m::iterator i = files.begin(); i != files.end(); ++i)
+        {
+            int   p;
+            float k;
+
+            while (i->second.file->result_page_sample(p, k))
+            {
+                ground_part_m::iterator j = parts.find(p);
+
+                if (j != parts.end())
+                {
+                    ground_query& g = grounds[j->second.q];
+
+                    g.k = std::max(g.k, k * (j->second.k1 - j->second.k0)
+                                                          + j->second.k0);
+                    g.n--;
+
+                    parts.erase(j);
+                }
+            }
+        }
+
+        finish_ground(false);
+    }
+}
+
+// Cancel the outstanding samples of file f, which is being released, after
+// gathering any that have completed. Each query losing a sample fails.
+
+void scm_system::cancel_ground(int f)
+{
+    if (!grounds.empty())
+    {
+        update_ground();
+
+        for (ground_part_m::iterator j = parts.begin(); j != parts.end(); )
+            if (j->second.f == f)
+            {
+                ground_query& g = grounds[j->second.q];
+
+                g.n--;
+                g.fail = true;
+
+                parts.erase(j++);
+            }
+            else ++j;
+
+        finish_ground(false);
+    }
+}
+
+// Deliver the results of all completed ground queries, or of all queries if
+// a is true, failing those still outstanding. Remove the queries before
+// calling back, as a callback may well make a new query.
+
+void scm_system::finish_ground(bool a)
+{
+    ground_query_m done;
+
+    for (ground_query_m::iterator i = grounds.begin(); i != grounds.end(); )
+        if (a || i->second.n == 0)
+        {
+            done.insert(*i);
+            grounds.erase(i++);
+        }
+        else ++i;
+
+    if (a)
+        parts.clear();
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    for (ground_query_m::iterator i = done.begin(); i != done.end(); ++i)
+        if (i->second.f)
+        {
+            if (i->second.fail || i->second.n > 0)
+                i->second.f(i->second.d, nan);
+            else
+                i->second.f(i->second.d, i->second.k);
+        }
+}
+
 /// Render a 2D overlay of the contents of all caches. This can be a helpful
 /// visual debugging tool as well as an effective demonstration of the inner
 /// workings of the library. @see scm_cache::render
@@ -452,6 +783,181 @@ bool scm_system::get_synchronous() const
     return sync;
 }
 
+/// Set the prefetch look-ahead distance in frames. Pages are requested in
+/// advance for the view anticipated this many frames ahead of the current one.
+/// Set 0 to disable predictive prefetch. @see scm_cache::fetch_page
+
+void scm_system::set_prefetch(int n)
+{
+    ahead = n;
+}
+
+/// Return the prefetch look-ahead distance in frames.
+
+int scm_system::get_prefetch() const
+{
+    return ahead;
+}
+
+/// Set the step queue prefetch look-ahead distance in frames. During playback,
+/// pages are requested in advance for views sampled along the queue up to this
+/// many frames ahead of the current time, at the current rate of playback.
+/// Set 0 to disable step queue prefetch. @see set_scene_blend
+
+void scm_system::set_tour_prefetch(int n)
+{
+    tour_ahead = n;
+}
+
+/// Return the step queue prefetch look-ahead distance in frames.
+
+int scm_system::get_tour_prefetch() const
+{
+    return tour_ahead;
+}
+
+/// Set the number of frames that the loads of a page requested together for
+/// all images of a scene may wait for one another. Pages arriving early are
+/// held until the rest arrive, so that all images of the page appear in the
+/// same frame. Set 0 to disable load grouping. @see scm_scene::touch_page
+
+void scm_system::set_group_wait(int n)
+{
+    group_wait = n;
+}
+
+/// Return the load group wait limit in frames.
+
+int scm_system::get_group_wait() const
+{
+    return group_wait;
+}
+
+/// Pin all pages of level less than l in every cache, so that they are never
+/// ejected. The first two levels, for example, are 30 pages that every view
+/// needs. Set 0 to pin no pages by level. @see scm_cache::pin_share
+
+void scm_system::set_pin_level(int l)
+{
+    pin_level = l;
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+        i->second.cache->set_pin_level(l);
+}
+
+/// Return the pin level threshold.
+
+int scm_system::get_pin_level() const
+{
+    return pin_level;
+}
+
+/// Pin all pages with the given indices in every cache, such as the pages
+/// around the points of interest of a tour. This replaces any indices given
+/// previously. Give an empty list to pin no pages by index. Pinned pages not
+/// yet resident are prefetched in the frames that follow. @see pin_prefetch
+
+void scm_system::set_pin_pages(const std::vector<long long>& v)
+{
+    pin_pages = v;
+    pin_fetch = true;
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+        i->second.cache->set_pin_pages(v);
+}
+
+/// Report the pinned capacity of all caches: the number of resident pinned
+/// pages, and the number of atlas lines that pinned pages may hold.
+
+void scm_system::get_pin_stats(int& count, int& limit)
+{
+    count = 0;
+    limit = 0;
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+    {
+        count += i->second.cache->get_pin_count();
+        limit += i->second.cache->get_pin_limit();
+    }
+}
+
+/// Report the prefetch statistics of all caches: the number of prefetch
+/// requests made, the number of prefetched pages later requested on demand
+/// (hits), and the number of prefetched pages never requested (waste).
+
+void scm_system::get_prefetch_stats(int& count, int& hits, int& waste)
+{
+    count = 0;
+    hits  = 0;
+    waste = 0;
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+    {
+        count += i->second.cache->get_fetch_count();
+        hits  += i->second.cache->get_fetch_hits();
+        waste += i->second.cache->get_fetch_waste();
+    }
+}
+
+/// Report the constant page statistics of all caches: the number of atlas
+/// lines holding constant values, and the number of page requests served by
+/// them without loading.
+
+void scm_system::get_const_stats(int& lines, int& count)
+{
+    lines = 0;
+    count = 0;
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+    {
+        lines += i->second.cache->get_const_lines();
+        count += i->second.cache->get_const_count();
+    }
+}
+
+/// Report the page sharing statistics of all caches: the number of loaded
+/// pages hashed, and the number of those found identical to a resident page
+/// and so given its atlas line. Their ratio is the hit rate.
+
+void scm_system::get_dedup_stats(int& count, int& hits)
+{
+    count = 0;
+    hits  = 0;
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+    {
+        count += i->second.cache->get_dedup_count();
+        hits  += i->second.cache->get_dedup_hits();
+    }
+}
+
+/// Report the load group statistics: the number of groups of more than one
+/// load requested, the number of frames during which any group was partially
+/// arrived and held back, and the number of groups released incomplete after
+/// waiting the limit. @see set_group_wait
+
+void scm_system::get_group_stats(int& count, int& partial, int& broken)
+{
+    count   = group_count;
+    partial = group_partial;
+    broken  = group_broken;
+}
+
+/// Report the reduced proxy statistics of all caches: the number of proxies
+/// loaded, and the number of those since replaced by their full content.
+
+void scm_system::get_proxy_stats(int& count, int& refined)
+{
+    count   = 0;
+    refined = 0;
+
+    for (active_cache_i i = caches.begin(); i != caches.end(); ++i)
+    {
+        count   += i->second.cache->get_proxy_count();
+        refined += i->second.cache->get_refine_count();
+    }
+}
+
 //------------------------------------------------------------------------------
 
 /// Return the ground level of current scene at the given location. O(log n).
@@ -471,6 +977,106 @@ float scm_system::get_current_ground(const double *v) const
     return 1.f;
 }
 
+/// Return the ground levels of the current scene at many locations at once.
+/// Locations are grouped by page so that each page is read only once, and
+/// large batches are sampled in parallel. This may incur data access in the
+/// render thread. @see scm_sample::get
+///
+/// @param v Array of n vectors from the center of the planet.
+/// @param k Array of n ground level outputs.
+/// @param n Number of locations.
+
+void scm_system::get_current_ground(const double *v, float *k, int n) const
+{
+    if (fore0 && fore1 && fore0 != fore1)
+    {
+        std::vector<float> t(n);
+
+        fore0->get_current_ground(v, k,     n);
+        fore1->get_current_ground(v, &t[0], n);
+
+        for (int i = 0; i < n; ++i)
+            k[i] = std::max(k[i], t[i]);
+    }
+    else if (fore0)
+        fore0->get_current_ground(v, k, n);
+    else if (fore1)
+        fore1->get_current_ground(v, k, n);
+    else
+        std::fill(k, k + n, 1.f);
+}
+
+/// Query the ground level of the current scene at the given location without
+/// blocking on data access. Return an immediate estimate, drawn from the most
+/// recent sample or the page catalog, and deliver the precise result to the
+/// callback during a later update_cache. The estimate errs high, which is the
+/// safe direction for collision detection.
+///
+/// @param v Vector from the center of the planet to the query position.
+/// @param f Callback to receive the result, called on the render thread.
+/// @param d Data pointer passed to the callback.
+
+float scm_system::get_current_ground(const double *v, scm_ground_f f, void *d)
+{
+    const int q = query++;
+
+    ground_query& g = grounds[q];
+
+    g.f = f;
+    g.d = d;
+    g.k = -std::numeric_limits<float>::max();
+
+    float k = -std::numeric_limits<float>::max();
+
+    // Query each foreground scene. A scene making no file sample has given a
+    // precise result already.
+
+    scm_scene *s[2] = { fore0, (fore1 != fore0) ? fore1 : 0 };
+
+    for (int i = 0; i < 2; ++i)
+        if (s[i])
+        {
+            int   n = g.n;
+            float r = s[i]->query_current_ground(v, q);
+
+            if (n == g.n)
+                g.k = std::max(g.k, r);
+
+            k = std::max(k, r);
+        }
+
+    if (s[0] == 0 && s[1] == 0)
+    {
+        g.k = 1.f;
+        k   = 1.f;
+    }
+    return k;
+}
+
+/// Intersect a ray with the ground of the current scene, as for picking or
+/// line-of-sight tests. The page tree is traversed front-to-back using the
+/// page extrema, and height data is sampled only in the leaf pages hit.
+/// Return false if the ray misses. @see scm_scene::get_ray_ground
+///
+/// @param p Ray origin relative to the center of the planet.
+/// @param d Ray direction.
+/// @param t Distance to the intersection, in units of the length of d.
+
+bool scm_system::get_ray_ground(const double *p, const double *d, double& t) const
+{
+    double t0;
+    double t1;
+
+    bool b0 = fore0 &&                   fore0->get_ray_ground(p, d, t0);
+    bool b1 = fore1 && fore1 != fore0 && fore1->get_ray_ground(p, d, t1);
+
+    if (b0 && b1) t = std::min(t0, t1);
+    else if  (b0) t = t0;
+    else if  (b1) t = t1;
+
+    return (b0 || b1);
+}
+
 /// Return the minimum ground level of the current scene, e.g. the radius of
 /// the planet at the bottom of the deepest valley. O(1).
 
@@ -556,7 +1162,11 @@ int scm_system::acquire_scm(const std::string& name)
                 {
                     caches[cp].cache = new scm_cache(this, cp.n, cp.c, cp.b);
                     caches[cp].uses  = 1;
+
+                    caches[cp].cache->set_pin_level(pin_level);
+                    caches[cp].cache->set_pin_pages(pin_pages);
                 }
+                pin_fetch = true;
 
                 // Associate the index, file, and cache in the reverse look-up.
 
@@ -600,6 +1210,10 @@ int scm_system::release_scm(const std::string& name)
         cache_param cp(files[name].file);
         caches[cp].cache->update(0, true);
 
+        // Complete or cancel any ground queries sampling the file.
+
+        cancel_ground(files[name].index);
+
         // Delete the file.
 
         delete files[name].file;
@@ -616,6 +1230,34 @@ int scm_system::release_scm(const std::string& name)
     return -1;
 }
 
+/// Reload the page catalog of the named SCM file after it has been patched in
+/// place. Pages whose content has changed are discarded from the cache, to be
+/// requested anew. Return false if the file is not loaded or cannot be
+/// reloaded. @see scm_file::reload
+
+bool scm_system::reload_scm(const std::string& name)
+{
+    scm_log("reload_scm %s", name.c_str());
+
+    active_file_m::iterator i = files.find(name);
+
+    if (i != files.end() && i->second.file)
+    {
+        std::vector<long long> c;
+
+        if (i->second.file->reload(c))
+        {
+            if (scm_cache *cache = get_cache(i->second.index))
+                for (size_t j = 0; j < c.size(); ++j)
+                    cache->drop(i->second.index, c[j]);
+
+            pin_fetch = true;
+            return true;
+        }
+    }
+    return false;
+}
+
 //------------------------------------------------------------------------------
 
 /// Return the scene with the given name.
@@ -665,6 +1307,48 @@ float scm_system::get_page_sample(int f, const double *v)
         return 1.f;
 }
 
+/// Sample an SCM file at n locations. @see scm_file::get_page_sample
+///
+/// @param f File index
+/// @param v Array of n vectors from the center of the planet.
+/// @param k Array of n sample outputs.
+/// @param n Number of locations.
+
+void scm_system::get_page_sample(int f, const double *v, float *k, int n)
+{
+    if (scm_file *file = get_file(f))
+        file->get_page_sample(v, k, n);
+    else
+        std::fill(k, k + n, 1.f);
+}
+
+/// Begin an asynchronous sample of an SCM file on behalf of ground query q,
+/// and return an immediate estimate. @see scm_file::query_page_sample
+///
+/// @param f  File index
+/// @param q  Ground query identifier
+/// @param v  Vector from the center of the planet to the query position.
+/// @param k0 Normalization minimum of the image sampled
+/// @param k1 Normalization maximum of the image sampled
+
+float scm_system::query_page_sample(int f, int q, const double *v,
+                                    float k0, float k1)
+{
+    float k = 1.f;
+
+    if (scm_file *file = get_file(f))
+    {
+        const int p = query++;
+
+        if (file->query_page_sample(p, v, k))
+        {
+            parts[p] = ground_part(q, f, k0, k1);
+            grounds[q].n++;
+        }
+    }
+    return k;
+}
+
 /// Determine the minimum and maximum values of an SCM file page. O(log n).
 /// @see scm_file::get_page_bounds
 ///
@@ -699,3 +1383,86 @@ bool scm_system::get_page_status(int f, long long i)
 }
 
 //------------------------------------------------------------------------------
+
+/// Begin a load group, to which the page requests of all images of a scene at
+/// one page index are added. Return its identifier, or zero if load grouping
+/// is disabled. The group is recorded only when a request joins it, as most
+/// touched pages are resident and request nothing. @see scm_scene::touch_page
+
+int scm_system::open_group()
+{
+    if (group_wait > 0)
+    {
+        if (++group <= 0) group = 1;
+        return group;
+    }
+    return 0;
+}
+
+/// Note a load request added to group g, recording the group at its first
+/// request. @see scm_cache::get_page
+
+void scm_system::join_group(int g)
+{
+    load_group_m::iterator i = groups.find(g);
+
+    if (i == groups.end())
+        i = groups.insert(std::make_pair(g, load_group(frame))).first;
+
+    i->second.n++;
+}
+
+/// End the requests of group g. A group of fewer than two loads need not wait
+/// and is discarded.
+
+void scm_system::close_group(int g)
+{
+    load_group_m::iterator i = groups.find(g);
+
+    if (i != groups.end())
+    {
+        if (i->second.n < 2)
+            groups.erase(i);
+        else
+            group_count++;
+    }
+}
+
+/// Note the arrival of a load of group g. @see scm_cache::update
+
+void scm_system::land_group(int g)
+{
+    load_group_m::iterator i = groups.find(g);
+
+    if (i != groups.end())
+        i->second.a++;
+}
+
+/// Release group g before all of its loads arrive, so that the loads held for
+/// it return their pixel buffers. @see scm_cache::update
+
+void scm_system::break_group(int g)
+{
+    load_group_m::iterator i = groups.find(g);
+
+    if (i != groups.end() && !i->second.done)
+    {
+        i->second.done = true;
+        group_broken++;
+    }
+}
+
+/// Return true if the held loads of group g may be uploaded.
+/// @see scm_cache::release
+
+bool scm_system::is_group_done(int g) const
+{
+    load_group_m::const_iterator i = groups.find(g);
+
+    if (i != groups.end())
+        return i->second.done;
+    else
+        return true;
+}
+
+//------------------------------------------------------------------------------
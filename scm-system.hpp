@@ -95,6 +95,13 @@ typedef std::vector<scm_step *>::iterator scm_step_i;
 typedef std::vector<scm_scene *>           scm_scene_v;
 typedef std::vector<scm_scene *>::iterator scm_scene_i;
 
+/// An scm_ground_f receives the result of an asynchronous ground query, along
+/// with the pointer given when the query was made. A query that cannot be
+/// completed, because a file it samples is released, receives NaN.
+/// @see scm_system::get_current_ground
+
+typedef void (*scm_ground_f)(void *, float);
+
 //------------------------------------------------------------------------------
 /// @cond INTERNAL
 
@@ -161,6 +168,54 @@ struct cache_param
 typedef std::map<cache_param, active_cache>           active_cache_m;
 typedef std::map<cache_param, active_cache>::iterator active_cache_i;
 
+/// A ground_query structure represents an asynchronous ground query awaiting
+/// the completion of n file samples.
+
+struct ground_query
+{
+    ground_query() : f(0), d(0), n(0), k(0), fail(false) { }
+
+    scm_ground_f f;     // Result callback
+    void        *d;     // Result callback data
+    int          n;     // Samples outstanding
+    float        k;     // Result so far
+    bool         fail;  // A sample was cancelled
+};
+
+typedef std::map<int, ground_query> ground_query_m;
+
+/// A ground_part structure represents one file sample of a ground query, with
+/// the normalization of the image sampled.
+
+struct ground_part
+{
+    ground_part()                                 : q(-1), f(-1), k0(0), k1(1) { }
+    ground_part(int q, int f, float k0, float k1) : q( q), f( f), k0(k0), k1(k1) { }
+
+    int   q;   // Ground query identifier
+    int   f;   // File index
+    float k0;  // Normalization minimum
+    float k1;  // Normalization maximum
+};
+
+typedef std::map<int, ground_part> ground_part_m;
+
+/// A load_group structure represents the loads of one page index requested
+/// together for all images of a scene. Its pages are held on arrival and are
+/// uploaded to their caches in the same frame.
+
+struct load_group
+{
+    load_group(int t) : n(0), a(0), t(t), done(false) { }
+
+    int  n;     // Loads requested
+    int  a;     // Loads arrived
+    int  t;     // Frame of request
+    bool done;  // Ready for upload
+};
+
+typedef std::map<int, load_group> load_group_m;
+
 /// @endcond
 //------------------------------------------------------------------------------
 
@@ -180,6 +235,7 @@ public:
     scm_system(int w, int h, int d, int l);
    ~scm_system();
 
+    void       prep_sphere(const double *, const double *, const int *, int) const;
     void     render_sphere(const double *, const double *, int) const;
 
     /// @name System queries
@@ -232,12 +288,32 @@ public:
     void        set_synchronous(bool);
     bool        get_synchronous() const;
 
+    void        set_prefetch(int);
+    int         get_prefetch() const;
+    void        set_tour_prefetch(int);
+    int         get_tour_prefetch() const;
+    void        set_group_wait(int);
+    int         get_group_wait() const;
+    void        get_prefetch_stats(int&, int&, int&);
+    void        get_const_stats(int&, int&);
+    void        get_dedup_stats(int&, int&);
+    void        get_proxy_stats(int&, int&);
+    void        get_group_stats(int&, int&, int&);
+
+    void        set_pin_level(int);
+    int         get_pin_level() const;
+    void        set_pin_pages(const std::vector<long long>&);
+    void        get_pin_stats(int&, int&);
+
     /// @}
     /// @name Data queries
     /// @{
 
     float       get_current_ground(const double *) const;
+    void        get_current_ground(const double *, float *, int) const;
+    float       get_current_ground(const double *, scm_ground_f, void *);
     float       get_minimum_ground()               const;
+    bool        get_ray_ground(const double *, const double *, double&) const;
 
     /// @}
     /// @name Data path handlers
@@ -253,15 +329,25 @@ public:
 
     int     acquire_scm(const std::string&);
     int     release_scm(const std::string&);
+    bool     reload_scm(const std::string&);
 
     scm_scene *find_scene(const std::string&) const;
     scm_cache  *get_cache(int);
     scm_file   *get_file (int);
 
     float       get_page_sample(int f, const double *v);
+    void        get_page_sample(int f, const double *v, float *k, int n);
+    float     query_page_sample(int f, int q, const double *v, float, float);
     bool        get_page_status(int f, long long i);
     void        get_page_bounds(int f, long long i, float& r0, float& r1);
 
+    int          open_group();
+    void         join_group(int);
+    void        close_group(int);
+    void         land_group(int);
+    void        break_group(int);
+    bool      is_group_done(int) const;
+
     /// @}
 
 private:
@@ -284,10 +370,45 @@ private:
     active_cache_m caches;
     active_pair_m  pairs;
 
+    ground_query_m grounds;
+    ground_part_m  parts;
+
     int            serial;
+    int            query;
     int            frame;
     bool           sync;
     double         fade;
+    int            ahead;
+
+    load_group_m   groups;
+    int            group;
+    int            group_wait;
+    int            group_count;
+    int            group_partial;
+    int            group_broken;
+
+    int                    pin_level;
+    std::vector<long long> pin_pages;
+    mutable bool           pin_fetch;
+
+    mutable double motion_M[2][16];
+    mutable int    motion_t[2];
+
+    int            tour_ahead;
+    int            tour_frame;
+    double         tour_t;
+    double         tour_dt;
+    mutable int    tour_next;
+
+    bool predict(const double *, double *) const;
+    void update_ground();
+    void cancel_ground(int);
+    void finish_ground(bool);
+    void tour_prefetch(const double *, const double *, int) const;
+    void pin_prefetch() const;
+    scm_step tour_step(double) const;
+    void get_queue_scenes(double, scm_scene *&, scm_scene *&,
+                                  scm_scene *&, scm_scene *&) const;
 };
 
 //------------------------------------------------------------------------------
@@ -11,16 +11,25 @@
 // more details.
 
 #include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
 #include <GL/glew.h>
 #include <tiffio.h>
 
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "scm-task.hpp"
 #include "scm-file.hpp"
+#include "scm-cache.hpp"
+#include "scm-bcn.hpp"
 
 //------------------------------------------------------------------------------
 
 scm_task::scm_task()
-    : scm_item()
+    : scm_item(), r(false), q(false), g(0), k(0)
 {
 }
 
@@ -30,11 +39,17 @@ scm_task::scm_task()
 /// @param i Page index
 
 scm_task::scm_task(int f, long long i)
-    : scm_item(f, i), o(0), n(0), c(0), b(0), u(0), d(false)
+    : scm_item(f, i), o(0), n(0), c(0), b(0), e(0), m(0), z(0), v(0),
+      y(false), h(0), r(false), q(false), g(0), u(0), d(false), k(0)
 {
 }
 
 /// Construct a load task. Map the PBO to provide a destination for the loader.
+/// If the destination cache compresses its pages then the buffer receives the
+/// compressed blocks of a full atlas line. If it stores 32-bit pages as half
+/// floats then the buffer receives half floats. If it shares the lines of
+/// identical pages then the loader also hashes the page content. If its atlas
+/// is mipmapped then the buffer receives every level of the page in turn.
 ///
 /// @param f File index
 /// @param i Page index
@@ -44,20 +59,29 @@ scm_task::scm_task(int f, long long i)
 /// @param b Page bits per channel
 /// @param u Pixel buffer object
 /// @param C Destination cache
+/// @param k Load priority
 
-scm_task::scm_task(int f, long long i, uint64 o, int n, int c, int b, GLuint u, scm_cache *C)
-    : scm_item(f, i), o(o), n(n), c(c), b(b), u(u), d(false), C(C)
+scm_task::scm_task(int f, long long i, uint64 o, int n, int c, int b, GLuint u, scm_cache *C, float k)
+    : scm_item(f, i), o(o), n(n), c(c), b(b), e(C->get_atlas_bits()),
+      m(C->get_line_size()), z(C->get_bcn_form()), v(C->get_mip_levels()),
+      y(C->get_dedup()), h(0), r(false), q(false), g(0), u(u), d(false),
+      C(C), k(k)
 {
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, u);
     {
-        const size_t s = size_t(n + 2) * size_t(n + 2) * scm_pixel_size(c, b);
+        size_t s = 0;
+
+        for (int j = 0; j <= v; ++j)
+            s += level_size(j);
+
         glBufferData(GL_PIXEL_UNPACK_BUFFER, s, 0, GL_STREAM_DRAW);
         p = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
     }
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
-/// Upload the pixel buffer to the OpenGL texture object.
+/// Upload the pixel buffer to the OpenGL texture object, including each mipmap
+/// level if the atlas has them.
 ///
 /// @param x Location of upper-left pixel
 /// @param y Location of upper-left pixel
@@ -67,9 +91,30 @@ void scm_task::make_page(int x, int y)
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, u);
     {
         glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, n + 2, n + 2,
-                                     scm_external_form(c, b),
-                                     scm_external_type(c, b), 0);
+
+        size_t a = 0;
+
+        for (int j = 0; j <= v; ++j)
+        {
+            const int w = (n + 2) >> j;
+
+            if (z)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, j, x >> j, y >> j,
+                                          m >> j, m >> j, z,
+                                          GLsizei(level_size(j)),
+                                          (const GLvoid *) a);
+            else if (e != b)
+                glTexSubImage2D(GL_TEXTURE_2D, j, x >> j, y >> j, w, w,
+                                             scm_external_form(c, b),
+                                             GL_HALF_FLOAT_ARB,
+                                             (const GLvoid *) a);
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, j, x >> j, y >> j, w, w,
+                                             scm_external_form(c, b),
+                                             scm_external_type(c, b),
+                                             (const GLvoid *) a);
+            a += level_size(j);
+        }
     }
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
@@ -90,7 +135,13 @@ void scm_task::dump_page()
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
-/// Load a page. On success, mark the buffer as dirty.
+/// Load a page. On success, mark the buffer as dirty. If the destination cache
+/// stores pages in a format other than that of the file, or needs the hash of
+/// the page content, load to a temporary buffer and hash and convert it into
+/// the pixel buffer, which is write-only. @see code_page
+///
+/// If a reduced proxy is requested, read only a subset of the page's strips
+/// and interpolate the rest. The flag is cleared if the full page was read.
 ///
 /// This method is called by a loader thread and exists solely to marshal
 /// the entensive argument list of the global function scm_load_page.
@@ -100,7 +151,106 @@ void scm_task::dump_page()
 
 bool scm_task::load_page(const char *name, TIFF *T)
 {
-    return (d = scm_load_page(name, i, T, o, n + 2, n + 2, c, b, p));
+    std::vector<uint8> t;
+    void              *q = p;
+
+    if (z || e != b || y || v)
+    {
+        t.resize(size_t(n + 2) * size_t(n + 2) * scm_pixel_size(c, b));
+        q = &t.front();
+    }
+
+    if (r)
+        d = scm_load_proxy(name, i, T, o, n + 2, n + 2, c, b,
+                           C->get_proxy_stride(), r, q);
+    else
+        d = scm_load_page (name, i, T, o, n + 2, n + 2, c, b, q);
+
+    if (d && q != p)
+        code_page(q);
+
+    return d;
+}
+
+/// Load the page of this task from an SCM pack. Packs are read in full, as
+/// their payloads are not divided into strips.
+///
+/// @param name Pack name (used for generating error pages)
+/// @param P    SCM pack pointer
+
+bool scm_task::load_page(const char *name, const scm_pack *P)
+{
+    r = false;
+
+    if (z || e != b || y || v)
+    {
+        std::vector<uint8> t(size_t(n + 2) * size_t(n + 2) * scm_pixel_size(c, b));
+
+        if ((d = scm_load_page(name, i, P, o, n + 2, n + 2, c, b, &t.front())))
+            code_page(&t.front());
+        return d;
+    }
+    return (d = scm_load_page(name, i, P, o, n + 2, n + 2, c, b, p));
+}
+
+/// Hash a loaded page if requested, unless it is a reduced proxy, and copy it
+/// to the pixel buffer in the atlas format, either as-is, by block compression,
+/// or by conversion to half float. If the atlas is mipmapped, reduce the page
+/// repeatedly and append each level likewise. This is called by a loader
+/// thread.
+///
+/// The page line divides evenly at each level, so each reduced texel averages
+/// samples of one page only. The gutter, a copy of the neighboring page edges,
+/// is averaged with the page edge, approximating the filtering of the seam.
+///
+/// @param t Loaded page pixel buffer
+
+void scm_task::code_page(const void *t)
+{
+    const size_t s = size_t(n + 2) * size_t(n + 2) * scm_pixel_size(c, b);
+
+    if (y && !r)
+        h = scm_hash(t, s);
+
+    std::vector<uint8> level;
+
+    const uint8 *q = (const uint8 *) t;
+    uint8       *P = (uint8       *) p;
+
+    for (int j = 0, w = n + 2; j <= v; ++j, w /= 2)
+    {
+        if (j)
+        {
+            std::vector<uint8> next(size_t(w) * size_t(w)
+                                              * scm_pixel_size(c, b));
+            scm_reduce(w * 2, w * 2, c, b, q, &next.front());
+            level.swap(next);
+            q = &level.front();
+        }
+
+        if (z)
+            scm_bcn_encode(w, w, c, q, P);
+        else if (e != b)
+            scm_half_copy(size_t(w) * size_t(w) * c, (const float *) q,
+                                                          (uint16 *) P);
+        else
+            memcpy(P, q, size_t(w) * size_t(w) * scm_pixel_size(c, b));
+
+        P += level_size(j);
+    }
+}
+
+/// Return the size in bytes of mipmap level j of this task's page, as stored
+/// in the pixel buffer.
+///
+/// @param j Mipmap level
+
+size_t scm_task::level_size(int j) const
+{
+    if (z)
+        return scm_bcn_size(m >> j, m >> j, c);
+    else
+        return size_t((n + 2) >> j) * size_t((n + 2) >> j) * scm_pixel_size(c, e);
 }
 
 //------------------------------------------------------------------------------
@@ -186,4 +336,230 @@ GLsizei scm_pixel_size(uint16 c, uint16 b)
     return c * b / 8;
 }
 
+/// Select an OpenGL half float internal texture format
+///
+/// @param c Channels per pixel
+
+GLenum scm_half_form(uint16 c)
+{
+    switch (c)
+    {
+    case  1: return GL_LUMINANCE16F_ARB;
+    case  2: return GL_LUMINANCE_ALPHA16F_ARB;
+    case  3: return GL_RGB16F_ARB;
+    default: return GL_RGBA16F_ARB;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Convert a float to a half float, rounding to nearest even. Out-of-range
+// values become infinite, and NaN remains NaN.
+
+static uint16 half(float f)
+{
+    uint32 x;
+
+    memcpy(&x, &f, sizeof (x));
+
+    const uint32 s = (x >> 16) & 0x8000;
+    const uint32 m =  x        & 0x7FFFFF;
+    const int    E = int((x >> 23) & 0xFF);
+    const int    e = E - 127 + 15;
+
+    if (E == 0xFF)
+        return uint16(s | 0x7C00 | (m ? 0x200 : 0));
+    if (e >= 31)
+        return uint16(s | 0x7C00);
+
+    uint32 h;
+    uint32 r;
+    uint32 k;
+
+    if (e <= 0)
+    {
+        // The result is subnormal, or zero.
+
+        if (e < -10)
+            return uint16(s);
+
+        const int t = 14 - e;
+
+        h = (m | 0x800000) >> t;
+        r = (m | 0x800000) & ((1u << t) - 1);
+        k = 1u << (t - 1);
+    }
+    else
+    {
+        h = (uint32(e) << 10) | (m >> 13);
+        r = m & 0x1FFF;
+        k = 0x1000;
+    }
+
+    // A carry out of the mantissa correctly increments the exponent.
+
+    if (r > k || (r == k && (h & 1)))
+        h++;
+
+    return uint16(s | h);
+}
+
+/// Convert n floats to half floats, as required for upload to a half float
+/// texture. Use the F16C instructions where the compiler targets them.
+///
+/// @param n Value count
+/// @param f Source floats
+/// @param h Destination half floats
+
+void scm_half_copy(size_t n, const float *f, uint16 *h)
+{
+    size_t i = 0;
+
+#if defined(__F16C__) || defined(__AVX2__)
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i *) (h + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(f + i), 0));
+#endif
+    for (; i < n; ++i)
+        h[i] = half(f[i]);
+}
+
+//------------------------------------------------------------------------------
+
+// Reduce the w-by-h image p of c channels of type T by half into q, averaging
+// each 2x2 block of samples.
+
+template <typename T> static void reduce(int w, int h, int c, const T *p, T *q)
+{
+    const size_t r = size_t(w) * c;
+
+    for (int i = 0; i < h / 2; ++i)
+        for (int j = 0; j < w / 2; ++j)
+            for (int d = 0; d < c; ++d)
+            {
+                const T *s = p + size_t(2 * i) * r + size_t(2 * j) * c + d;
+
+                double x = (double(s[0]) + double(s[c])
+                          + double(s[r]) + double(s[r + c])) / 4.0;
+
+                if (std::numeric_limits<T>::is_integer)
+                    x += 0.5;
+
+                *q++ = T(x);
+            }
+}
+
+/// Reduce a w-by-h image by half in each dimension, averaging each 2x2 block of
+/// pixels. This produces the mipmap levels of a page.
+///
+/// @param w Image width
+/// @param h Image height
+/// @param c Channels per pixel
+/// @param b Bits per channel
+/// @param p Source pixel buffer
+/// @param q Destination pixel buffer
+
+void scm_reduce(int w, int h, int c, int b, const void *p, void *q)
+{
+    switch (b)
+    {
+    case  8: reduce(w, h, c, (const uint8  *) p, (uint8  *) q); break;
+    case 16: reduce(w, h, c, (const uint16 *) p, (uint16 *) q); break;
+    case 32: reduce(w, h, c, (const float  *) p, (float  *) q); break;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static const uint64 P1 = 11400714785074694791ULL;
+static const uint64 P2 = 14029467366897019727ULL;
+static const uint64 P3 =  1609587929392839161ULL;
+static const uint64 P4 =  9650029242287828579ULL;
+static const uint64 P5 =  2870177450012600261ULL;
+
+static uint64 rotl(uint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64 mix(uint64 a, uint64 x)
+{
+    return rotl(a + x * P2, 31) * P1;
+}
+
+static uint64 merge(uint64 a, uint64 x)
+{
+    return (a ^ mix(0, x)) * P1 + P4;
+}
+
+static uint64 read64(const uint8 *p)
+{
+    uint64 x;
+    memcpy(&x, p, sizeof (x));
+    return x;
+}
+
+static uint32 read32(const uint8 *p)
+{
+    uint32 x;
+    memcpy(&x, p, sizeof (x));
+    return x;
+}
+
+/// Return the 64-bit xxHash (XXH64, seed zero) of n bytes of data p. This
+/// identifies page content for the sharing of atlas lines by identical pages.
+/// Values are read in host byte order, which matches XXH64 on little-endian
+/// hosts. A hash is meaningful only within one process.
+///
+/// @param p Data
+/// @param n Data length in bytes
+
+uint64 scm_hash(const void *p, size_t n)
+{
+    const uint8 *s = (const uint8 *) p;
+    const uint8 *e = (const uint8 *) p + n;
+
+    uint64 h;
+
+    if (n >= 32)
+    {
+        uint64 v1 = P1 + P2;
+        uint64 v2 = P2;
+        uint64 v3 = 0;
+        uint64 v4 = 0 - P1;
+
+        for (; s + 32 <= e; s += 32)
+        {
+            v1 = mix(v1, read64(s +  0));
+            v2 = mix(v2, read64(s +  8));
+            v3 = mix(v3, read64(s + 16));
+            v4 = mix(v4, read64(s + 24));
+        }
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(h, v1);
+        h = merge(h, v2);
+        h = merge(h, v3);
+        h = merge(h, v4);
+    }
+    else h = P5;
+
+    h += uint64(n);
+
+    for (; s + 8 <= e; s += 8)
+        h = rotl(h ^ mix(0, read64(s)), 27) * P1 + P4;
+    for (; s + 4 <= e; s += 4)
+        h = rotl(h ^ (uint64(read32(s)) * P1), 23) * P2 + P3;
+    for (; s     < e; s += 1)
+        h = rotl(h ^ (uint64(*s) * P5), 11) * P1;
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
 //------------------------------------------------------------------------------
@@ -22,6 +22,7 @@
 
 class scm_file;
 class scm_cache;
+class scm_pack;
 
 //------------------------------------------------------------------------------
 
@@ -35,30 +36,71 @@ struct scm_task : public scm_item
 {
     scm_task();
     scm_task(int, long long);
-    scm_task(int, long long, uint64, int, int, int, GLuint, scm_cache *);
+    scm_task(int, long long, uint64, int, int, int, GLuint, scm_cache *, float);
 
     void make_page(int, int);
     bool load_page(const char *, TIFF *);
+    bool load_page(const char *, const scm_pack *);
+    void code_page(const void *);
+    size_t level_size(int) const;
     void dump_page();
 
     uint64     o;          ///< SCM TIFF file offset of this page
     int        n;          ///< Page size
     int        c;          ///< Page channel per pixel
     int        b;          ///< Page bits per channel
+    int        e;          ///< Atlas bits per channel
+    int        m;          ///< Atlas line size in pixels
+    GLenum     z;          ///< Compressed internal format, or zero
+    int        v;          ///< Atlas mipmap levels beyond the base
+    bool       y;          ///< Content hash requested
+    uint64     h;          ///< Content hash
+    bool       r;          ///< Reduced proxy requested
+    bool       q;          ///< Full content of a resident proxy requested
+    int        g;          ///< Load group, or zero
     GLuint     u;          ///< Pixel unpack buffer object
     bool       d;          ///< Pixel unpack buffer dirty flag
     void      *p;          ///< Pixel unpack buffer map address
     scm_cache *C;          ///< Destination cache
+    float      k;          ///< Load priority
+
+    /// Determine the order of two tasks, highest priority first, and proxies
+    /// before full pages of equal priority.
+
+    bool operator<(const scm_task& that) const {
+        if     (k > that.k) return true;
+        if     (k < that.k) return false;
+        if     (r > that.r) return true;
+        if     (r < that.r) return false;
+        return scm_item::operator<(that);
+    }
+};
+
+/// An scm_task_priority sets the priority of a queued task.
+/// @see scm_queue::try_update
+
+struct scm_task_priority
+{
+    scm_task_priority(float k) : k(k) { }
+
+    void operator()(scm_task& task) const { task.k = k; }
+
+    float k;
 };
 
 //------------------------------------------------------------------------------
 /// @file
 
 GLuint  scm_internal_form(uint16 c, uint16 b);
+GLuint  scm_half_form    (uint16 c);
 GLuint  scm_external_form(uint16 c, uint16 b);
 GLuint  scm_external_type(uint16 c, uint16 b);
 GLsizei scm_pixel_size   (uint16 c, uint16 b);
 
+void    scm_half_copy(size_t, const float *, uint16 *);
+uint64  scm_hash     (const void *, size_t);
+void    scm_reduce   (int, int, int, int, const void *, void *);
+
 //------------------------------------------------------------------------------
 
 #endif
@@ -0,0 +1,547 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "scm-write.hpp"
+#include "scm-index.hpp"
+#include "scm-log.hpp"
+
+//------------------------------------------------------------------------------
+
+// Complete the current directory of T and give its offset in o. Checkpoint it
+// to fix its location, then write it in place and begin the next.
+
+static bool finish(TIFF *T, uint64& o)
+{
+    if (TIFFCheckpointDirectory(T))
+    {
+        o = TIFFCurrentDirOffset(T);
+
+        if (TIFFWriteDirectory(T))
+            return true;
+    }
+    return false;
+}
+
+// Set the fields of the current directory of T describing a w-by-h page with
+// c channels of b bits.
+
+static void format(TIFF *T, int w, int h, int c, int b)
+{
+    TIFFSetField(T, TIFFTAG_IMAGEWIDTH,      w);
+    TIFFSetField(T, TIFFTAG_IMAGELENGTH,     h);
+    TIFFSetField(T, TIFFTAG_BITSPERSAMPLE,   b);
+    TIFFSetField(T, TIFFTAG_SAMPLESPERPIXEL, c);
+    TIFFSetField(T, TIFFTAG_PLANARCONFIG,    PLANARCONFIG_CONTIG);
+    TIFFSetField(T, TIFFTAG_PHOTOMETRIC,     (c < 3) ? PHOTOMETRIC_MINISBLACK
+                                                     : PHOTOMETRIC_RGB);
+    TIFFSetField(T, TIFFTAG_SAMPLEFORMAT,    (b < 32) ? SAMPLEFORMAT_UINT
+                                                      : SAMPLEFORMAT_IEEEFP);
+
+    if (c == 2 || c == 4)
+    {
+        uint16 e = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(T, TIFFTAG_EXTRASAMPLES, 1, &e);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Return sample k of the given buffer of b-bit samples.
+
+static double get_sample(const void *p, size_t k, int b)
+{
+    switch (b)
+    {
+    case  8: return ((const uint8  *) p)[k];
+    case 16: return ((const uint16 *) p)[k];
+    default: return ((const float  *) p)[k];
+    }
+}
+
+// Set sample k of the given buffer of b-bit samples.
+
+static void set_sample(void *p, size_t k, int b, double v)
+{
+    switch (b)
+    {
+    case  8: ((uint8  *) p)[k] = uint8 (v); break;
+    case 16: ((uint16 *) p)[k] = uint16(v); break;
+    default: ((float  *) p)[k] = float (v); break;
+    }
+}
+
+// Determine the number of rows per strip of a page, giving strips of roughly
+// 64 KB.
+
+static int rows(int w, int c, int b)
+{
+    return std::max(1, int(65536 / (size_t(w) * size_t(c) * size_t(b) / 8)));
+}
+
+/// Compress a page for writing by scm_append_page. The page is deflated in
+/// strips of roughly 64 KB, with horizontal differencing of integer samples.
+/// This function is thread-safe. Return true on success.
+///
+/// @param w Page width
+/// @param h Page height
+/// @param c Page channels per pixel
+/// @param b Page bits per channel
+/// @param p Page pixel buffer
+/// @param d Compressed strip data
+/// @param s Compressed strip sizes
+
+bool scm_deflate_page(int w, int h, int c, int b, const void *p,
+                      std::vector<uint8>& d, std::vector<uint64>& s)
+{
+    const size_t r = size_t(w) * size_t(c) * size_t(b) / 8;
+    const int    n = rows(w, c, b);
+
+    std::vector<uint8> t(r * n);
+
+    d.clear();
+    s.clear();
+
+    for (int y = 0; y < h; y += n)
+    {
+        const int m = std::min(n, h - y);
+
+        memcpy(&t.front(), (const uint8 *) p + y * r, m * r);
+
+        // Difference each row from right to left, as libtiff does.
+
+        for (int j = 0; j < m; ++j)
+            for (int k = (w - 1) * c - 1; k >= 0; --k)
+            {
+                if (b == 8)
+                {
+                    uint8  *q = (uint8  *) (&t.front() + j * r);
+                    q[k + c] = uint8 (q[k + c] - q[k]);
+                }
+                if (b == 16)
+                {
+                    uint16 *q = (uint16 *) (&t.front() + j * r);
+                    q[k + c] = uint16(q[k + c] - q[k]);
+                }
+            }
+
+        uLongf z = compressBound(uLong(m * r));
+        size_t o = d.size();
+
+        d.resize(o + z);
+
+        if (compress2(&d[o], &z, &t.front(), uLong(m * r), 6) != Z_OK)
+            return false;
+
+        d.resize(o + z);
+        s.push_back(uint64(z));
+    }
+    return true;
+}
+
+/// Append a page compressed by scm_deflate_page to an SCM TIFF opened for
+/// writing. Return true on success.
+///
+/// @param T TIFF file
+/// @param w Page width
+/// @param h Page height
+/// @param c Page channels per pixel
+/// @param b Page bits per channel
+/// @param d Compressed strip data
+/// @param s Compressed strip sizes
+/// @param o Offset of the written page directory
+
+bool scm_append_page(TIFF *T, int w, int h, int c, int b,
+                     const std::vector<uint8>& d,
+                     const std::vector<uint64>& s, uint64& o)
+{
+    format(T, w, h, c, b);
+
+    TIFFSetField(T, TIFFTAG_COMPRESSION,  COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(T, TIFFTAG_PREDICTOR,    (b < 32) ? PREDICTOR_HORIZONTAL
+                                                   : PREDICTOR_NONE);
+    TIFFSetField(T, TIFFTAG_ROWSPERSTRIP, rows(w, c, b));
+
+    const uint8 *p = d.empty() ? 0 : &d.front();
+
+    size_t k = 0;
+
+    for (size_t j = 0; j < s.size(); k += size_t(s[j]), ++j)
+
+        if (k + size_t(s[j]) > d.size() ||
+            TIFFWriteRawStrip(T, uint32(j), (void *) (p + k),
+                                            tsize_t(s[j])) < 0)
+        {
+            scm_log("scm_append_page failed strip %d", int(j));
+            return false;
+        }
+
+    return finish(T, o);
+}
+
+/// Compress a page and append it to an SCM TIFF opened for writing. Return
+/// true on success. @see scm_deflate_page
+///
+/// @param T TIFF file
+/// @param w Page width
+/// @param h Page height
+/// @param c Page channels per pixel
+/// @param b Page bits per channel
+/// @param p Page pixel buffer
+/// @param o Offset of the written page directory
+
+bool scm_write_page(TIFF *T, int w, int h, int c, int b, const void *p, uint64& o)
+{
+    std::vector<uint8>  d;
+    std::vector<uint64> s;
+
+    if (scm_deflate_page(w, h, c, b, p, d, s))
+        return scm_append_page(T, w, h, c, b, d, s, o);
+    else
+        return false;
+}
+
+/// Append a copy of the page at offset o of SCM TIFF U to the SCM TIFF T. The
+/// compressed strips are copied as-is, without decoding. Return true on
+/// success.
+///
+/// @param T Destination TIFF file, opened for writing
+/// @param U Source TIFF file
+/// @param o Offset of the source page directory
+/// @param O Offset of the written page directory
+
+bool scm_copy_page(TIFF *T, TIFF *U, uint64 o, uint64& O)
+{
+    if (TIFFSetSubDirectory(U, o))
+    {
+        uint32 w = 0, h = 0, r = 0;
+        uint16 c = 0, b = 0, z = COMPRESSION_NONE, p = PREDICTOR_NONE;
+
+        TIFFGetField(U, TIFFTAG_IMAGEWIDTH,      &w);
+        TIFFGetField(U, TIFFTAG_IMAGELENGTH,     &h);
+        TIFFGetField(U, TIFFTAG_BITSPERSAMPLE,   &b);
+        TIFFGetField(U, TIFFTAG_SAMPLESPERPIXEL, &c);
+        TIFFGetField(U, TIFFTAG_ROWSPERSTRIP,    &r);
+        TIFFGetField(U, TIFFTAG_COMPRESSION,     &z);
+        TIFFGetField(U, TIFFTAG_PREDICTOR,       &p);
+
+        format(T, w, h, c, b);
+
+        TIFFSetField(T, TIFFTAG_COMPRESSION,  z);
+        TIFFSetField(T, TIFFTAG_ROWSPERSTRIP, r);
+
+        if (p != PREDICTOR_NONE)
+            TIFFSetField(T, TIFFTAG_PREDICTOR, p);
+
+        // Copy each raw strip.
+
+        uint64 *n = 0;
+        tstrip_t s = TIFFNumberOfStrips(U);
+
+        if (TIFFGetField(U, TIFFTAG_STRIPBYTECOUNTS, &n) && n)
+        {
+            std::vector<uint8> v;
+
+            for (tstrip_t k = 0; k < s; ++k)
+            {
+                v.resize(size_t(n[k]));
+
+                if (TIFFReadRawStrip (U, k, &v.front(), tsize_t(n[k])) < 0 ||
+                    TIFFWriteRawStrip(T, k, &v.front(), tsize_t(n[k])) < 0)
+                {
+                    scm_log("scm_copy_page failed strip %d", int(k));
+                    return false;
+                }
+            }
+            return finish(T, O);
+        }
+    }
+    return false;
+}
+
+/// Write the page catalog of an SCM TIFF to its first directory. The TIFF must
+/// be opened for update, and the catalog must be sorted by page index. The
+/// first directory is rewritten at the end of the file, leaving its previous
+/// copy in place, so any catalog offset referring to it remains valid. Return
+/// true on success.
+///
+/// @param T TIFF file
+/// @param x Page indices
+/// @param o Page directory offsets
+/// @param a Page minima, c samples per page
+/// @param z Page maxima, c samples per page
+/// @param n Page count
+/// @param c Channels per pixel
+/// @param b Bits per channel
+
+bool scm_write_catalog(TIFF *T, const uint64 *x, const uint64 *o,
+                                const void   *a, const void   *z,
+                                uint64 n, int c, int b)
+{
+    const TIFFDataType t = (b ==  8) ? TIFF_BYTE
+                         : (b == 16) ? TIFF_SHORT : TIFF_FLOAT;
+
+    static char xn[] = "SCMIndex";
+    static char on[] = "SCMOffset";
+    static char an[] = "SCMMinimum";
+    static char zn[] = "SCMMaximum";
+
+    const TIFFFieldInfo info[] = {
+        { 0xFFB1, TIFF_VARIABLE2, TIFF_VARIABLE2, TIFF_LONG8, FIELD_CUSTOM, 1, 1, xn },
+        { 0xFFB2, TIFF_VARIABLE2, TIFF_VARIABLE2, TIFF_LONG8, FIELD_CUSTOM, 1, 1, on },
+        { 0xFFB3, TIFF_VARIABLE2, TIFF_VARIABLE2, t,          FIELD_CUSTOM, 1, 1, an },
+        { 0xFFB4, TIFF_VARIABLE2, TIFF_VARIABLE2, t,          FIELD_CUSTOM, 1, 1, zn },
+    };
+
+    if (TIFFSetDirectory(T, 0))
+    {
+        // Define the catalog fields unless the file already has them.
+
+        for (int k = 0; k < 4; ++k)
+            if (TIFFFindField(T, info[k].field_tag, TIFF_ANY) == 0)
+                TIFFMergeFieldInfo(T, info + k, 1);
+
+        const uint32 m = uint32(n);
+        const uint32 s = uint32(n * c);
+
+        if (TIFFSetField(T, 0xFFB1, m, x) &&
+            TIFFSetField(T, 0xFFB2, m, o) &&
+            TIFFSetField(T, 0xFFB3, s, a) &&
+            TIFFSetField(T, 0xFFB4, s, z))
+            return (TIFFRewriteDirectory(T) != 0);
+    }
+    scm_log("scm_write_catalog failed");
+    return false;
+}
+
+/// Read the page catalog of an SCM TIFF from its first directory. The extrema
+/// are given as raw samples, as many per page as there are channels. Return
+/// false if the file has no catalog.
+///
+/// @param T TIFF file
+/// @param x Page indices
+/// @param o Page directory offsets
+/// @param a Page minima
+/// @param z Page maxima
+
+bool scm_read_catalog(TIFF *T, std::vector<uint64>& x, std::vector<uint64>& o,
+                               std::vector<uint8>&  a, std::vector<uint8>&  z)
+{
+    uint64 n = 0;
+    void  *p = 0;
+    uint16 c = 1;
+    uint16 b = 8;
+
+    x.clear();
+    o.clear();
+    a.clear();
+    z.clear();
+
+    if (TIFFSetDirectory(T, 0))
+    {
+        TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &b);
+        TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &c);
+
+        if (TIFFGetField(T, 0xFFB1, &n, &p) && p)
+            x.assign((uint64 *) p, (uint64 *) p + n);
+        if (TIFFGetField(T, 0xFFB2, &n, &p) && p)
+            o.assign((uint64 *) p, (uint64 *) p + n);
+
+        a.resize(x.size() * c * b / 8);
+        z.resize(x.size() * c * b / 8);
+
+        if (!a.empty() && TIFFGetField(T, 0xFFB3, &n, &p) && p)
+            memcpy(&a.front(), p, std::min(a.size(), size_t(n) * b / 8));
+        if (!z.empty() && TIFFGetField(T, 0xFFB4, &n, &p) && p)
+            memcpy(&z.front(), p, std::min(z.size(), size_t(n) * b / 8));
+    }
+    return (!x.empty() && x.size() == o.size());
+}
+
+// Catalog entry of a page being patched: its offset and per-channel extrema.
+
+struct patch_entry
+{
+    uint64              o;
+    std::vector<double> lo;
+    std::vector<double> hi;
+};
+
+// Decode the page at offset o of T and extend the c per-channel extrema lo and
+// hi to include its samples.
+
+static bool extend(TIFF *T, uint64 o, int c, int b, double *lo, double *hi)
+{
+    if (TIFFSetSubDirectory(T, o))
+    {
+        uint32 w = 0;
+        uint32 h = 0;
+
+        TIFFGetField(T, TIFFTAG_IMAGEWIDTH,  &w);
+        TIFFGetField(T, TIFFTAG_IMAGELENGTH, &h);
+
+        const tsize_t  S = TIFFStripSize(T);
+        const tstrip_t N = TIFFNumberOfStrips(T);
+
+        std::vector<uint8> p(size_t(S) * N);
+
+        for (tstrip_t k = 0; k < N; ++k)
+            if (TIFFReadEncodedStrip(T, k, &p[k * S], -1) < 0)
+                return false;
+
+        for (size_t k = 0; k < size_t(w) * h; ++k)
+            for (int d = 0; d < c; ++d)
+            {
+                const double v = get_sample(&p.front(), k * c + d, b);
+
+                lo[d] = std::min(lo[d], v);
+                hi[d] = std::max(hi[d], v);
+            }
+
+        return true;
+    }
+    return false;
+}
+
+/// Patch the page catalog of an SCM TIFF opened for update, after appending
+/// new or replacement pages to it. Each given page index is set to the given
+/// directory offset, being inserted into the catalog if new. The extrema of
+/// each patched page and each of its ancestors are recomputed from the page
+/// data and the extrema of its children, deepest first. Return true on
+/// success.
+///
+/// @param T TIFF file
+/// @param i Indices of the appended pages
+/// @param o Directory offsets of the appended pages
+
+bool scm_patch_catalog(TIFF *T, const std::vector<uint64>& i,
+                                const std::vector<uint64>& o)
+{
+    std::vector<uint64> x;
+    std::vector<uint64> O;
+    std::vector<uint8>  a;
+    std::vector<uint8>  z;
+
+    uint16 c = 1;
+    uint16 b = 8;
+
+    if (!scm_read_catalog(T, x, O, a, z))
+    {
+        scm_log("scm_patch_catalog missing catalog");
+        return false;
+    }
+
+    TIFFGetField(T, TIFFTAG_BITSPERSAMPLE,   &b);
+    TIFFGetField(T, TIFFTAG_SAMPLESPERPIXEL, &c);
+
+    // Expand the catalog into a map, with extrema as doubles.
+
+    std::map<uint64, patch_entry> m;
+
+    for (size_t k = 0; k < x.size(); ++k)
+    {
+        patch_entry& e = m[x[k]];
+
+        e.o = O[k];
+
+        for (int d = 0; d < c; ++d)
+        {
+            e.lo.push_back(get_sample(&a.front(), k * c + d, b));
+            e.hi.push_back(get_sample(&z.front(), k * c + d, b));
+        }
+    }
+
+    // Apply the patch, noting each patched page and its ancestors.
+
+    std::set<uint64> s;
+
+    for (size_t k = 0; k < i.size() && k < o.size(); ++k)
+    {
+        m[i[k]].o = o[k];
+
+        for (long long j = (long long) i[k]; ; j = scm_page_parent(j))
+        {
+            if (m.find(uint64(j)) != m.end())
+                s.insert(uint64(j));
+            else
+                scm_log("scm_patch_catalog missing ancestor %lld", j);
+
+            if (j < 6) break;
+        }
+    }
+
+    // Recompute extrema deepest first. Deeper pages have greater indices.
+
+    for (std::set<uint64>::reverse_iterator j = s.rbegin(); j != s.rend(); ++j)
+    {
+        patch_entry& e = m[*j];
+
+        e.lo.assign(c,  HUGE_VAL);
+        e.hi.assign(c, -HUGE_VAL);
+
+        if (e.o && !extend(T, e.o, c, b, &e.lo.front(), &e.hi.front()))
+            scm_log("scm_patch_catalog failed to read page %lld", (long long) *j);
+
+        for (long long k = 0; k < 4; ++k)
+        {
+            std::map<uint64, patch_entry>::iterator q =
+                m.find(uint64(scm_page_child((long long) *j, k)));
+
+            if (q != m.end())
+                for (int d = 0; d < c; ++d)
+                {
+                    e.lo[d] = std::min(e.lo[d], q->second.lo[d]);
+                    e.hi[d] = std::max(e.hi[d], q->second.hi[d]);
+                }
+        }
+    }
+
+    // Flatten the map and write the catalog.
+
+    x.clear();
+    O.clear();
+    a.assign(m.size() * c * b / 8, 0);
+    z.assign(m.size() * c * b / 8, 0);
+
+    size_t k = 0;
+
+    std::map<uint64, patch_entry>::iterator j;
+
+    for (j = m.begin(); j != m.end(); ++j, ++k)
+    {
+        x.push_back(j->first);
+        O.push_back(j->second.o);
+
+        for (int d = 0; d < c; ++d)
+        {
+            if (j->second.lo[d] <= j->second.hi[d])
+            {
+                set_sample(&a.front(), k * c + d, b, j->second.lo[d]);
+                set_sample(&z.front(), k * c + d, b, j->second.hi[d]);
+            }
+        }
+    }
+
+    return scm_write_catalog(T, &x.front(), &O.front(),
+                                &a.front(), &z.front(), x.size(), c, b);
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+// Copyright (C) 2011-2012 Robert Kooima
+//
+// LIBSCM is free software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+//
+// This program is distributed in the hope that it will be useful, but WITH-
+// OUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+
+#ifndef SCM_WRITE_HPP
+#define SCM_WRITE_HPP
+
+#include <vector>
+#include <tiffio.h>
+
+//------------------------------------------------------------------------------
+/// @file
+///
+/// These functions write SCM TIFF files. An SCM TIFF is a BigTIFF with one
+/// directory per page. The first directory carries the page catalog: sorted
+/// page indices (0xFFB1), directory offsets (0xFFB2), and per-channel minima
+/// (0xFFB3) and maxima (0xFFB4). Pages are written one at a time, each giving
+/// its directory offset, and the catalog is written last to the first
+/// directory of a file opened for update.
+///
+/// An existing SCM TIFF may be patched in place by appending new or replacement
+/// pages to a file opened for append, and then patching the catalog with their
+/// indices and offsets. The extrema of the patched pages and their ancestors
+/// are recomputed. All other data remains untouched.
+///
+/// Page compression is separate from page writing so that many threads may
+/// compress pages while one thread writes them.
+
+bool scm_deflate_page (int, int, int, int, const void *, std::vector<uint8>&,
+                                                         std::vector<uint64>&);
+bool scm_append_page  (TIFF *, int, int, int, int, const std::vector<uint8>&,
+                                                   const std::vector<uint64>&,
+                                                                    uint64&);
+bool scm_write_page   (TIFF *, int, int, int, int, const void *, uint64&);
+bool scm_copy_page    (TIFF *, TIFF *, uint64,                    uint64&);
+bool scm_write_catalog(TIFF *, const uint64 *, const uint64 *,
+                               const void   *, const void   *, uint64, int, int);
+bool scm_read_catalog (TIFF *, std::vector<uint64>&, std::vector<uint64>&,
+                               std::vector<uint8>&,  std::vector<uint8>&);
+bool scm_patch_catalog(TIFF *, const std::vector<uint64>&,
+                               const std::vector<uint64>&);
+
+//------------------------------------------------------------------------------
+
+#endif